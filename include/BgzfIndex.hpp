@@ -0,0 +1,57 @@
+#ifndef BGZF_INDEX_H_
+#define BGZF_INDEX_H_
+
+#include "common.h"
+#include <vector>
+#include <string>
+
+/*
+ * Block-offset index of a BGZF compressed (bgzip) file, read from the "{fname}.gzi"
+ * index written by "bgzip -i" or "samtools faidx". A BGZF file is a series of
+ * independently compressed gzip blocks of at most 64 KB uncompressed each, so
+ * any range of uncompressed bytes can be recovered by inflating only the
+ * blocks that overlap it.
+ */
+class BgzfIndex
+{
+public:
+    /*
+     * Load the index entries of the blocks overlapping the uncompressed range
+     * [ustart..uend). Only those entries are kept in memory, so every processor
+     * can load just the part of the index covering its own records.
+     */
+    BgzfIndex(const std::string& bgzf_fname, MPI_Offset ustart, MPI_Offset uend);
+
+    std::string get_gzi_fname() const { return bgzf_fname + ".gzi"; }
+
+    /*
+     * Total number of bytes in the file after decompression.
+     */
+    MPI_Offset getusize() const { return usize; }
+
+    /*
+     * Find the compressed byte range [cstart..cend) of the blocks that have to be inflated
+     * to get the uncompressed range [ustart..uend), which must be covered by the loaded
+     * entries. Those blocks inflate into the uncompressed range [blockstart..blockend).
+     */
+    void getblockrange(MPI_Offset ustart, MPI_Offset uend, MPI_Offset& cstart, MPI_Offset& cend, MPI_Offset& blockstart, MPI_Offset& blockend) const;
+
+    /*
+     * Inflate the consecutive BGZF blocks stored in @src (@srclen bytes) into @dst,
+     * which must have room for @dstlen bytes. Returns the number of bytes written.
+     */
+    static size_t inflateblocks(const char *src, size_t srclen, char *dst, size_t dstlen);
+
+    /*
+     * Check the gzip header of @fname for the BGZF extra subfield.
+     */
+    static bool isbgzf(const std::string& fname);
+
+private:
+    std::string bgzf_fname;
+    std::vector<MPI_Offset> coffsets; /* compressed offsets of the loaded blocks, plus the end of the last one */
+    std::vector<MPI_Offset> uoffsets; /* uncompressed offsets of the loaded blocks, plus the end of the last one */
+    MPI_Offset usize;
+};
+
+#endif
@@ -28,7 +28,14 @@ public:
         }
     };
 
-    DistributedFastaData(FastaIndex& index);
+    /*
+     * If @sharedstore is set, processors on the same node that sit in the same grid
+     * row (or column) keep a single copy of its reads in an MPI-3 shared memory
+     * window instead of one copy each. Only one processor per node and grid row
+     * (or column) receives the reads, and the others read them in place.
+     */
+    DistributedFastaData(FastaIndex& index, bool sharedstore = false);
+    ~DistributedFastaData();
 
     FastaIndex& getindex() { return index; }
 
@@ -37,7 +44,34 @@ public:
     size_t getnumrowreads() const { return rowinfo.numreads; }
     size_t getnumcolreads() const { return colinfo.numreads; }
 
+    /*
+     * The grid rows (and columns) get contiguous ranges of reads holding about the
+     * same number of k-mers each, while CombBLAS gives every grid row the same number
+     * of matrix rows. The overlap matrices are therefore indexed by matrix ids rather
+     * than read ids: the reads of grid row r take the first ids of the r-th block of
+     * getdimsize() ids in order, and the rest of that block stays empty. getreadid()
+     * returns -1 for the empty ids. Local matrix indices are read indices into
+     * the row and column buffers either way.
+     */
+    size_t getdimsize() const { return dimsize; }
+    size_t getmatrixdim() const { return dimsize * (dimdispls.size() - 1); }
+    size_t getrowmatrixstartid() const { return rowinfo.matrixstartid; }
+    size_t getcolmatrixstartid() const { return colinfo.matrixstartid; }
+    int64_t getmatrixid(size_t readid) const;
+    int64_t getreadid(int64_t matrixid) const;
+
+    /*
+     * collect_sequences() starts exchanging the reads of my grid row and column
+     * without blocking, and wait() is the only point where it synchronizes. Calling
+     * progress() in between (it never blocks) lets the bulk of the transfer start
+     * as soon as the read lengths have arrived. Reads that I own are not copied,
+     * so @mydna must outlive the row and column buffers. On diagonal processors the
+     * row and column buffers are the same object. With the shared store, the reads
+     * are only received by wait(), and the row and column buffers must not outlive
+     * this object, which owns the shared memory windows they point into.
+     */
     void collect_sequences(const DnaBuffer& mydna);
+    void progress();
     void wait();
 
     std::shared_ptr<DnaBuffer> getrowbuf() { return rowbuf; }
@@ -48,22 +82,50 @@ public:
     struct DimExchangeInfo
     {
         size_t startid, numreads;
+        size_t matrixstartid; /* matrix id of the first read */
         size_t reqbufsize, reqnumreads;
-        std::unique_ptr<size_t[]> reqreadlens;
+        std::vector<uint32_t> reqreadlens; /* handed over to the assembled DnaBuffer */
         std::unique_ptr<uint8_t[]> reqbuf;
-        std::vector<MPI_Request> sendreqs, recvreqs;
+        std::vector<FastaDataRequest> myreqs;
+        std::vector<MPI_Request> sendreqs, recvreqs, lenrecvreqs;
+        size_t localbytes = 0; /* bytes of my own reads that are served from @mydna instead of @reqbuf */
+        bool bufposted = false; /* whether the receives for @reqbuf have been posted */
+        MPI_Comm shmcomm = MPI_COMM_NULL; /* processors on my node in the same grid row (or column), if the shared store is used */
+        MPI_Win shmwin = MPI_WIN_NULL; /* shared window holding the read lengths followed by the encoded reads */
     };
 
 private:
     FastaIndex& index;
     bool isdiag;
+    bool sharedstore;
+    std::vector<size_t> dimdispls; /* dimdispls[r] is the global id of the first read of grid row (or column) r. |dimdispls| == procdim+1 */
+    size_t dimsize; /* matrix rows (or columns) per grid row (or column), which is the most reads any of them gets */
+    std::vector<int> dimrequesters; /* with the shared store, bit rc of dimrequesters[p] says whether processor p requests its grid row (rc=0) or column (rc=1) */
 
     std::shared_ptr<DnaBuffer> rowbuf, colbuf;
     DimExchangeInfo rowinfo, colinfo;
+    std::vector<uint32_t> myreadlens; /* lengths of my reads, kept alive for the sends */
+    const DnaBuffer *mydnaptr; /* my reads, which the row and column buffers point into */
+
+    void setupdimranges();
+    void getdimrange(int dimid, size_t& startid, size_t& numreads) const;
+    bool requestsdim(int rank, unsigned short rc) const;
+    void setupsharedstore();
+
+    /*
+     * Log how much alignment work every grid block is predicted to get, relative
+     * to the average, from the read lengths of the reads in its grid row and column.
+     * This is only a diagnostic of how well setupdimranges() did.
+     */
+    void logpredictedwork() const;
 
     void collect_dim_sequences(const DnaBuffer& mydna, DimExchangeInfo& diminfo);
-    void getremoterequests(std::vector<FastaDataRequest>& allrequests, std::vector<FastaDataRequest>& myrequests) const;
+    void post_dim_buffer_recvs(DimExchangeInfo& diminfo);
+    std::shared_ptr<DnaBuffer> assemble_dim_buffer(DimExchangeInfo& diminfo);
+    void post_dim_shared_recvs(DimExchangeInfo& diminfo);
+    std::shared_ptr<DnaBuffer> assemble_dim_shared_buffer(DimExchangeInfo& diminfo);
     void getgridrequests(std::vector<FastaDataRequest>& myrequests, size_t globalstartid, size_t count, unsigned short rc) const;
+    void getgridsends(std::vector<FastaDataRequest>& mysends, unsigned short rc) const;
 };
 
 #endif //LBL_DAL_DISTRIBUTEDFASTADATA_H
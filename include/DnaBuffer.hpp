@@ -12,27 +12,74 @@
 class DnaBuffer
 {
 public:
-    DnaBuffer(size_t bufsize) : bufhead(0), bufsize(bufsize), buf(new uint8_t[bufsize]) {}
-    DnaBuffer(size_t bufsize, size_t numreads, uint8_t *buf, const size_t *readlens);
+    DnaBuffer(size_t bufsize) : bufhead(0), bufsize(bufsize), buf(new uint8_t[bufsize]), segments(1, buf), nrunoffsets(1, 0) {}
+
+    /*
+     * @nrunoffsets and @nruns are the N runs of the reads in the same layout as
+     * the private members below. If they are omitted the reads have no N runs.
+     */
+    DnaBuffer(size_t bufsize, size_t numreads, uint8_t *buf, const size_t *readlens, std::vector<uint32_t> nrunoffsets = {}, std::vector<NRun> nruns = {});
+
+    /*
+     * Read i has length @readlens[i] and is stored in one of @segments at @readoffsets[i],
+     * as encoded by makeoffset(). The segments may point into @buf (which is owned by the
+     * new buffer, and can be null) or into memory owned by someone else, which must then
+     * outlive this buffer. @bufsize is only the size of @buf, and getrangebufsize() is only
+     * meaningful for ranges of reads stored in the same segment.
+     */
+    DnaBuffer(size_t bufsize, uint8_t *buf, std::vector<const uint8_t*> segments, std::vector<uint64_t> readoffsets, std::vector<uint32_t> readlens);
+
+    /*
+     * DnaBuffer owns @buf, so it can be moved but not copied.
+     */
+    DnaBuffer(DnaBuffer&& rhs) : bufhead(rhs.bufhead), bufsize(rhs.bufsize), buf(rhs.buf), segments(std::move(rhs.segments)), readoffsets(std::move(rhs.readoffsets)), readlens(std::move(rhs.readlens)), nrunoffsets(std::move(rhs.nrunoffsets)), nruns(std::move(rhs.nruns)) { rhs.buf = nullptr; }
 
     void push_back(char const *s, size_t len);
-    size_t size() const { return sequences.size(); }
+    size_t size() const { return readlens.size(); }
     size_t getbufsize() const { return bufsize; }
     size_t getrangebufsize(size_t start, size_t count) const;
-    const uint8_t* getbufoffset(size_t i) const { return sequences[i].data(); }
-    const DnaSeq& operator[](size_t i) const { return sequences[i]; }
+    const uint8_t* getbufoffset(size_t i) const { return segments[readoffsets[i] >> SEGMENT_SHIFT] + (readoffsets[i] & OFFSET_MASK); }
+    size_t getreadlen(size_t i) const { return readlens[i]; }
+
+    /*
+     * Sequences are not stored as DnaSeq objects, a view of read i is made on every call.
+     */
+    DnaSeq operator[](size_t i) const { return DnaSeq(readlens[i], const_cast<uint8_t*>(getbufoffset(i))); }
+
+    /*
+     * The N runs of read i, in increasing order, are getnruns(i)[0..getnumnruns(i)).
+     * Buffers of views into other memory don't keep track of N runs.
+     */
+    size_t getnumnruns(size_t i) const { return nrunoffsets.empty()? 0 : nrunoffsets[i+1] - nrunoffsets[i]; }
+    const NRun* getnruns(size_t i) const { return nrunoffsets.empty()? nruns.data() : nruns.data() + nrunoffsets[i]; }
+    const std::vector<uint32_t>& getnrunoffsets() const { return nrunoffsets; }
+    const std::vector<NRun>& getallnruns() const { return nruns; }
+
+    /*
+     * Number of bytes used to locate the reads and their N runs (everything but the encoded reads).
+     */
+    size_t getmetadatasize() const;
 
     std::string getasciifilecontents() const;
 
     static size_t computebufsize(const std::vector<size_t>& seqlens);
 
+    static uint64_t makeoffset(size_t segment, size_t offset) { return (static_cast<uint64_t>(segment) << SEGMENT_SHIFT) | offset; }
+
     ~DnaBuffer() { delete[] buf; }
 
 private:
+    static constexpr int SEGMENT_SHIFT = 56;
+    static constexpr uint64_t OFFSET_MASK = (static_cast<uint64_t>(1) << SEGMENT_SHIFT) - 1;
+
     size_t bufhead;
     const size_t bufsize;
     uint8_t *buf;
-    std::vector<DnaSeq> sequences;
+    std::vector<const uint8_t*> segments; /* memory the reads are stored in. Buffers built by push_back() have the single segment @buf */
+    std::vector<uint64_t> readoffsets; /* read i starts at byte (readoffsets[i] & OFFSET_MASK) of segments[readoffsets[i] >> SEGMENT_SHIFT] */
+    std::vector<uint32_t> readlens; /* read lengths, reads are limited to 2^32-1 bases just like their N runs */
+    std::vector<uint32_t> nrunoffsets; /* N runs of read i are nruns[nrunoffsets[i]..nrunoffsets[i+1]), or none if empty; at most 2^32-1 per buffer */
+    std::vector<NRun> nruns;
 };
 
 #endif
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 
 /*
  * Originally I wanted this class to be able to be used under two different
@@ -28,6 +29,15 @@
  * this later but right now I don't see any reason to.
  */
 
+/*
+ * A run [begin..end) of Ns within a sequence. DnaSeq stores Ns as As, so
+ * DnaBuffer keeps the N runs of each sequence on the side.
+ */
+struct NRun
+{
+    uint32_t begin, end;
+};
+
 class DnaSeq
 {
 public:
@@ -94,7 +104,21 @@ public:
      * returns integer code of given position:
      * 0 means A, 1 means C, 2 means G, and 3 means T.
      */
-    int operator[](size_t i) const;
+    int operator[](size_t i) const { return (memory[i >> 2] >> (6 - 2*(i & 3))) & 3; }
+
+    /*
+     * Returns the 32 nucleotides starting at position @i packed into a 64-bit
+     * word, with nucleotide i in the two most significant bits (the same layout
+     * as the longs of a Kmer). Positions past the end of the sequence read as 0.
+     * Use this instead of operator[] when scanning many consecutive nucleotides.
+     */
+    uint64_t getword(size_t i) const;
+
+    /*
+     * Same as getword, except it interprets the sequence as its reverse
+     * complement, i.e. getrcword(i) packs revcomp_at(i) .. revcomp_at(i+31).
+     */
+    uint64_t getrcword(size_t i) const;
 
     /*
      * Lexicographical comparison operator.
@@ -123,14 +147,32 @@ public:
      */
     static size_t bytesneeded(size_t n) { return (n+3)/4; }
 
+    /*
+     * 2-bit encode the @len nucleotides of the ASCII sequence @s into @mem, and decode
+     * them back into upper-case ASCII. These use SSE4.1 or AVX2 kernels when the CPU
+     * supports them (chosen at runtime), and fall back to the scalar versions otherwise.
+     * Every byte other than A, C, G and T (in either case) encodes like N, as an A, so
+     * all kernels give the same result for any input.
+     */
+    static void encode(char const *s, size_t len, uint8_t *mem);
+    static void decode(uint8_t const *mem, size_t len, char *s);
+    static void encodescalar(char const *s, size_t len, uint8_t *mem);
+    static void decodescalar(uint8_t const *mem, size_t len, char *s);
+
+    /*
+     * Name of the instruction set used by encode() and decode().
+     */
+    static char const* simdname();
+
     /*
      * getcodechar : [0,1,2,3,4] -> [A,C,G,T,X]
      * getcharcode : [A,a,C,c,G,g,T,t,N,n,...] -> [0,0,1,1,2,2,3,3,0,0,X]
      * getcharchar : [A,a,C,c,G,g,T,t,N,n,...] -> [A,A,C,C,G,G,T,T,A,A,X]
      */
     static char    getcodechar(int c)  { return chartab[c]; }
-    static uint8_t getcharcode(char c) { return codetab[(int)c]; }
+    static uint8_t getcharcode(char c) { return codetab[static_cast<uint8_t>(c)]; }
     static char    getcharchar(char c) { return getcodechar(getcharcode(c)); }
+    static bool    isambiguous(char c) { return (c | 0x20) == 'n'; }
 
     static constexpr char chartab[4+1] = {'A', 'C', 'G', 'T', 'X'};
     static constexpr uint8_t codetab[256] =
@@ -169,4 +211,60 @@ private:
     void compress(char const *s);
 };
 
+inline uint64_t DnaSeq::getword(size_t i) const
+{
+    if (i >= len) return 0;
+
+    size_t b = i >> 2;
+    size_t nb = numbytes();
+    int shift = 2 * (i & 3);
+    uint64_t word;
+    uint8_t next;
+
+    /*
+     * An unaligned window of 32 nucleotides spans up to 9 bytes. Near the
+     * end of the sequence, go through a zero-padded copy so that we never
+     * read past the bytes that belong to this sequence.
+     */
+    if (b + 9 <= nb)
+    {
+        std::memcpy(&word, memory + b, 8);
+        next = memory[b+8];
+    }
+    else
+    {
+        uint8_t tail[9] = {0};
+        std::memcpy(tail, memory + b, nb - b);
+        std::memcpy(&word, tail, 8);
+        next = tail[8];
+    }
+
+    word = __builtin_bswap64(word);
+
+    if (shift) word = (word << shift) | (next >> (8 - shift));
+    if (len - i < 32) word &= ~0ULL << (2 * (32 - (len - i)));
+
+    return word;
+}
+
+inline uint64_t DnaSeq::getrcword(size_t i) const
+{
+    if (i >= len) return 0;
+
+    /*
+     * revcomp_at(i+j) is the complement of nucleotide len-1-i-j, so grab the
+     * (up to) 32 nucleotides ending at len-1-i, complement them, and then
+     * reverse the order of the 2-bit codes within the word.
+     */
+    size_t n = std::min(len - i, static_cast<size_t>(32));
+    uint64_t mask = ~0ULL << (2 * (32 - n));
+    uint64_t word = (getword(len - i - n) & mask) ^ mask;
+
+    word = __builtin_bswap64(word);
+    word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    word = ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+
+    return word << (2 * (32 - n));
+}
+
 #endif
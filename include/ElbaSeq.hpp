@@ -0,0 +1,63 @@
+#ifndef ELBA_SEQ_H_
+#define ELBA_SEQ_H_
+
+#include "common.h"
+#include "FastaIndex.hpp"
+#include "DnaBuffer.hpp"
+
+/*
+ * An .elbaseq file stores the 2-bit encoded reads of a FASTA (or FASTQ) exactly as
+ * they are laid out in a DnaBuffer, so that ELBA can be restarted on the same dataset
+ * without parsing and encoding it again. All integers are little-endian uint64_t.
+ * The file consists of the following sections, one after the other:
+ *
+ *     header                      ElbaSeqHeader (64 bytes)
+ *     read lengths                numreads entries
+ *     buffer offsets              numreads+1 entries, where read i is stored in the buffer
+ *                                 bytes [bufoffsets[i]..bufoffsets[i+1])
+ *     name offsets                numreads+1 entries, where the name of read i is the
+ *                                 characters [nameoffsets[i]..nameoffsets[i+1])
+ *     names                       namebytes characters
+ *     N run offsets               numreads+1 entries, where the N runs of read i are
+ *                                 runs [nrunoffsets[i]..nrunoffsets[i+1])
+ *     N runs                      numnruns (begin, end) pairs of positions within the read
+ *     buffer                      bufsize bytes of 2-bit encoded reads
+ */
+struct ElbaSeqHeader
+{
+    char magic[8];
+    uint64_t version;
+    uint64_t numreads;
+    uint64_t bufsize;
+    uint64_t namebytes;
+    uint64_t numnruns;
+    uint64_t reserved[2];
+
+    static constexpr char elbaseq_magic[8] = {'E', 'L', 'B', 'A', 'S', 'E', 'Q', '\0'};
+    static constexpr uint64_t elbaseq_version = 2;
+
+    MPI_Offset readlensoffset() const { return sizeof(ElbaSeqHeader); }
+    MPI_Offset bufoffsetsoffset() const { return readlensoffset() + 8 * numreads; }
+    MPI_Offset nameoffsetsoffset() const { return bufoffsetsoffset() + 8 * (numreads+1); }
+    MPI_Offset namesoffset() const { return nameoffsetsoffset() + 8 * (numreads+1); }
+    MPI_Offset nrunoffsetsoffset() const { return namesoffset() + namebytes; }
+    MPI_Offset nrunsoffset() const { return nrunoffsetsoffset() + 8 * (numreads+1); }
+    MPI_Offset bufferoffset() const { return nrunsoffset() + 16 * numnruns; }
+
+    bool valid() const { return std::memcmp(magic, elbaseq_magic, 8) == 0 && version == elbaseq_version; }
+};
+
+static_assert(sizeof(ElbaSeqHeader) == 64);
+
+/*
+ * Check whether @fname starts with the .elbaseq magic bytes.
+ */
+bool iselbaseq(const std::string& fname);
+
+/*
+ * Collectively write my reads @buffer (with names @mynames) to the .elbaseq file @fname.
+ * Reads are written in the global order given by @index.
+ */
+void writeelbaseq(const std::string& fname, const FastaIndex& index, const DnaBuffer& buffer, const std::vector<std::string>& mynames);
+
+#endif
@@ -9,11 +9,19 @@ class FastaIndex
 public:
     typedef struct { size_t len, pos, bases; } Record;
 
-    FastaIndex(const std::string& fasta_fname, std::shared_ptr<CommGrid> commgrid);
+    /*
+     * If @distributed is true, every processor parses a slice of the FASTA index
+     * and the read partitioning is computed in parallel, so that no processor ever
+     * holds the records or names of all the reads. Otherwise the root processor
+     * parses the whole index and scatters the records.
+     */
+    FastaIndex(const std::string& fasta_fname, std::shared_ptr<CommGrid> commgrid, bool distributed = false);
 
     std::shared_ptr<CommGrid> getcommgrid() const { return commgrid; }
     std::string get_fasta_fname() const { return fasta_fname; }
     std::string get_faidx_fname() const { return fasta_fname + ".fai"; }
+    bool isbgzf() const { return bgzf; }
+    bool iselbaseq() const { return elbaseq; }
 
     size_t gettotrecords() const { return readdispls.back(); }
     size_t getreadcount(size_t i) const { return static_cast<size_t>(readcounts[i]); }
@@ -28,12 +36,32 @@ public:
     const std::vector<MPI_Count_type> getreadcounts() const { return readcounts; }
     const std::vector<MPI_Displ_type> getreaddispls() const { return readdispls; }
 
-    DnaBuffer getmydna() const;
+    /*
+     * Read and 2-bit encode my sequences. The FASTA is streamed through two
+     * alternating buffers of at most @windowsize bytes each (except for single
+     * records larger than that), so that the next window is read while the current
+     * one is being encoded. If @windowsize is zero, my whole chunk is read at once.
+     * FASTQ input is read the same way, since only the sequence lines of a record
+     * are ever read its quality lines are dropped. For BGZF input, each window reads
+     * the compressed blocks covering it, which are inflated before being encoded.
+     */
+    DnaBuffer getmydna(size_t windowsize = 0) const;
     void log(const DnaBuffer& buffer) const;
 
     static Record get_faidx_record(const std::string& line, std::string& name);
 
-    std::vector<std::string> bcastnames();
+    /*
+     * Moves the boundaries of the ordered partition given by @counts (the number
+     * of reads in each part) as little as needed for every part to get at least
+     * one read, as long as there are at least as many reads as parts.
+     */
+    static void ensure_nonempty_partition(std::vector<MPI_Count_type>& counts);
+
+    /*
+     * Names of my reads. The names of other processors' reads can be
+     * fetched from their owners with ReadNames.
+     */
+    const std::vector<std::string>& getmynames() const { return mynames; }
 
 private:
     std::shared_ptr<CommGrid> commgrid;
@@ -43,9 +71,30 @@ private:
     std::vector<MPI_Displ_type> readdispls; /* displacement counts for reads across all processors. Each processor gets a copy. |readdispls| == nprocs+1 */
     std::string fasta_fname; /* FASTA file name */
 
-    std::vector<std::string> rootnames;
+    std::vector<std::string> mynames; /* names of the reads local processor is responsible for */
+    bool distributed; /* whether the index was parsed in parallel */
+    bool bgzf; /* whether the input is BGZF compressed */
+    bool elbaseq; /* whether the input is an .elbaseq file of already encoded reads */
 
     void getpartition(std::vector<MPI_Count_type>& sendcounts);
+    void scatterfaidx();
+    void distributefaidx();
+
+    /*
+     * Build "{fasta_fname}.fai" in parallel when it doesn't exist yet. Every
+     * processor scans an equal byte slice of the FASTA for record boundaries,
+     * and records that cross slice boundaries are completed with scans
+     * over the neighbouring slices before the index is written out.
+     */
+    void buildfaidx();
+
+    /*
+     * Same for FASTQ input, where the index gets the extra quality offset column
+     * of "samtools fqidx". Every record must have single-line sequence and quality.
+     */
+    void buildfqidx();
+    void writefaidx(const std::string& myfaidx) const;
+    void readelbaseq();
 };
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef HPCBUFFER_H_
+#define HPCBUFFER_H_
+
+#include "DnaBuffer.hpp"
+#include <utility>
+
+/*
+ * Homopolymer-compressed (HPC) copies of the reads of a DnaBuffer, where every run
+ * of identical bases is collapsed into a single base. Sequencing errors in long reads
+ * are mostly wrong homopolymer lengths, which HPC k-mers don't see. A run of Ns is
+ * collapsed into a single N, so the HPC reads keep their N runs too.
+ *
+ * The length of every run is kept so that positions in the HPC reads can be mapped
+ * back to the original reads. Runs are almost always short, so their lengths are
+ * stored in a byte each, and the rare runs of 256 bases or more are stored on the side.
+ */
+class HpcBuffer
+{
+public:
+    HpcBuffer(const DnaBuffer& dna);
+
+    const DnaBuffer& getdna() const { return hpcdna; }
+    size_t size() const { return hpcdna.size(); }
+    size_t getreadlen(size_t i) const { return hpcdna.getreadlen(i); }
+
+    /*
+     * Number of bases of the original read @i in run @j, which is base @j of HPC read @i.
+     */
+    size_t getrunlen(size_t i, size_t j) const
+    {
+        size_t run = runoffsets[i] + j;
+        return runlens[run]? runlens[run] : getlongrunlen(run);
+    }
+
+    /*
+     * Number of bytes used for the run lengths.
+     */
+    size_t getrunlensize() const { return runlens.size() + runoffsets.size() * sizeof(runoffsets[0]) + longruns.size() * sizeof(longruns[0]); }
+
+private:
+    DnaBuffer hpcdna;
+    std::vector<size_t> runoffsets; /* runs of read i are runlens[runoffsets[i]..runoffsets[i+1]) */
+    std::vector<uint8_t> runlens; /* zero means the run is in @longruns */
+    std::vector<std::pair<size_t, uint32_t>> longruns; /* (run, length) sorted by run */
+
+    size_t getlongrunlen(size_t run) const;
+};
+
+#endif
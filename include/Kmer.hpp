@@ -25,7 +25,7 @@ public:
     typedef std::array<uint8_t,  NBYTES> BYTEARR;
 
     Kmer();
-    Kmer(const DnaSeq& s);
+    Kmer(const DnaSeq& s, size_t pos = 0);
     Kmer(char const *s);
     Kmer(const void *mem);
     Kmer(const Kmer& o);
@@ -51,6 +51,21 @@ public:
     static std::vector<Kmer> GetKmers(const DnaSeq& s);
     static std::vector<Kmer> GetRepKmers(const DnaSeq& s);
 
+    /*
+     * Only the k-mers that lie entirely within the nucleotides [begin..end) of @s,
+     * e.g. the stretch between two N runs. The first one starts at @begin.
+     */
+    static std::vector<Kmer> GetKmers(const DnaSeq& s, size_t begin, size_t end);
+    static std::vector<Kmer> GetRepKmers(const DnaSeq& s, size_t begin, size_t end);
+
+    /*
+     * Calls @f(repmer, i) for the representative of every k-mer of @s that lies within
+     * [begin..end), where i is where the k-mer starts, without building a vector. The
+     * k-mer and its reverse complement are rolled along together, one shift per nucleotide.
+     */
+    template <typename F>
+    static void ForeachRepKmer(const DnaSeq& s, size_t begin, size_t end, F&& f);
+
     template <int N>
     friend std::ostream& operator<<(std::ostream& os, const Kmer<N>& kmer);
 
@@ -59,7 +74,9 @@ private:
     union { MERARR  longs;
             BYTEARR bytes; };
 
-    void set_kmer(const DnaSeq& s);
+    void roll_forward(uint64_t code);
+    void roll_twin(uint64_t code);
+    void set_kmer(const DnaSeq& s, size_t pos);
     void set_kmer(char const *s, bool const revcomp = false);
 };
 
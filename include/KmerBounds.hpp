@@ -0,0 +1,57 @@
+#ifndef KMER_BOUNDS_H_
+#define KMER_BOUNDS_H_
+
+#include "common.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+ * Which k-mers are reliable: the ones seen at least @lower and at most @upper times
+ * in the reads. Fewer occurrences than that mostly come from sequencing errors, and
+ * more from repeats. LOWER_KMER_FREQ and UPPER_KMER_FREQ are only the defaults.
+ *
+ * If @minprob is positive, the bounds are instead picked by Select() once the k-mers
+ * are counted, with the same model as script/elba_bounds.py: a k-mer of the genome
+ * is read without error by each of the d reads covering it with probability
+ * p = (1-e)^k, so the number of times it is seen follows Binomial(d, p). The lower
+ * bound cuts off the first @minprob of that distribution (counting from 2) and the
+ * upper bound the last @minprob. @upper is then the most Select() may pick, since
+ * the single-exchange counting mode stops keeping the occurrences of a k-mer past it.
+ */
+struct KmerBounds
+{
+    int lower;
+    int upper;
+    double minprob; /* 0 for fixed bounds */
+
+    /*
+     * What Select() made of the histogram, for the logs.
+     */
+    int kmercoverage; /* most common count of the reliable k-mers, d*p */
+    int depth;        /* d */
+    double errorrate; /* e */
+
+    KmerBounds(int lower = LOWER_KMER_FREQ, int upper = UPPER_KMER_FREQ, double minprob = 0) : lower(lower), upper(upper), minprob(minprob), kmercoverage(0), depth(0), errorrate(0) {}
+
+    bool IsAutomatic() const { return minprob > 0; }
+
+    /*
+     * Empty string if the bounds make sense, the problem otherwise.
+     */
+    std::string Check() const;
+
+    std::string GetString() const;
+
+    /*
+     * Picks the bounds from the global histogram @histo of the k-mer counts (@histo[i]
+     * k-mers counted i times, the last bin holding everything counted that often or more),
+     * given that the k-mers in it were counted @numcounted times in total, out of the
+     * @numkmers k-mers parsed from the reads. The singletons need not be in there.
+     * Returns false, leaving the bounds as they are, if the histogram has no
+     * clear valley between the erroneous k-mers and the reliable ones.
+     */
+    bool Select(const std::vector<int64_t>& histo, int64_t numcounted, int64_t numkmers);
+};
+
+#endif
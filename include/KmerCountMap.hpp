@@ -0,0 +1,205 @@
+#ifndef KMER_COUNT_MAP_H_
+#define KMER_COUNT_MAP_H_
+
+#include "common.h"
+#include "Kmer.hpp"
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+typedef uint32_t PosInRead;
+typedef  int64_t ReadId;
+
+/*
+ * My partition of the distributed k-mer hash table: every k-mer I own, with the
+ * number of times it was seen and where (read id and position in read).
+ *
+ * The table uses open addressing with Robin Hood probing: an entry never sits further
+ * from its home slot than the entry it would displace. Lookups therefore scan a few
+ * contiguous slots instead of chasing list nodes, and can stop as soon as they
+ * are further from home than the slot they look at.
+ *
+ * It is filled in two stages, like a counting sort. First the k-mers are only counted.
+ * Once the k-mers outside the frequency bounds are erased, allocateoccurrences() gives
+ * every remaining k-mer a range of exactly as many occurrences as it was counted, all
+ * ranges being packed one after the other (CSR-style) in a read id array and a position
+ * array. The occurrences are then added to their ranges. So occurrences are only ever
+ * stored for the k-mers that are kept, and take 12 bytes each.
+ */
+class KmerCountMap
+{
+public:
+    struct Entry
+    {
+        TKmer kmer;
+        int count;       /* times seen, then occurrences added once allocateoccurrences() is called */
+        uint32_t offset; /* first of its occurrences */
+
+        /*
+         * Counts saturate at INT_MAX instead of overflowing, so the k-mers
+         * seen that often all look alike (and are way past any upper bound).
+         */
+        int increment() { return count < std::numeric_limits<int>::max()? ++count : count; }
+    };
+
+    KmerCountMap() : numentries(0), mask(0) {}
+
+    /*
+     * Make room for @n k-mers without growing.
+     */
+    void reserve(size_t n);
+
+    size_t size() const { return numentries; }
+
+    Entry* find(const TKmer& kmer) { return const_cast<Entry*>(static_cast<const KmerCountMap*>(this)->find(kmer)); }
+    const Entry* find(const TKmer& kmer) const;
+
+    /*
+     * Insert @kmer with no occurrences, unless it is already there.
+     */
+    Entry& insert(const TKmer& kmer) { return insert(kmer, kmer.GetHash()); }
+
+    /*
+     * Count the @numkmers k-mers packed in @buf (TKmer::NBYTES each), inserting the ones
+     * not there yet, and skipping the ones for which @keep(kmer) is false. Later k-mers'
+     * slots are prefetched while earlier ones are counted, which hides most of the cache
+     * misses of a bulk insert.
+     */
+    template <typename F>
+    void countpacked(const uint8_t *buf, size_t numkmers, F&& keep);
+
+    void erase(const TKmer& kmer);
+
+    /*
+     * Erase every entry for which @pred(entry) is true. Returns how many were erased.
+     */
+    template <typename P>
+    size_t eraseif(P&& pred);
+
+    /*
+     * Make room for count occurrences of every k-mer, and reset the counts. From then on,
+     * count is the number of occurrences added, which must never exceed the old count.
+     */
+    void allocateoccurrences();
+
+    void addoccurrence(Entry& entry, ReadId readid, PosInRead pos)
+    {
+        readids[entry.offset + entry.count] = readid;
+        positions[entry.offset + entry.count] = pos;
+        entry.count++;
+    }
+
+    /*
+     * Calls @f(readid, pos) for every occurrence of @entry, in the order they were added.
+     */
+    template <typename F>
+    void foreachoccurrence(const Entry& entry, F&& f) const;
+
+    /*
+     * Calls @f(entry) for every entry, in no particular order.
+     */
+    template <typename F>
+    void foreach(F&& f) const;
+
+    template <typename F>
+    void foreach(F&& f);
+
+    /*
+     * Bytes used by the slots and by the occurrences.
+     */
+    size_t gettablesize() const { return slots.size() * (sizeof(Entry) + sizeof(uint16_t)); }
+    size_t getoccurrencesize() const { return readids.size() * (sizeof(ReadId) + sizeof(PosInRead)); }
+
+private:
+    size_t numentries;
+    size_t mask; /* number of slots - 1, a power of 2 minus 1 */
+    std::vector<Entry> slots;
+    std::vector<uint16_t> dists; /* 0 for an empty slot, 1 + distance from the home slot otherwise */
+    std::vector<ReadId> readids;
+    std::vector<PosInRead> positions;
+
+    /*
+     * Slot indices use the low bits of the hash: the owner of a k-mer is picked
+     * by its high bits, which are therefore about the same for all my k-mers.
+     */
+    size_t home(uint64_t hash) const { return hash & mask; }
+
+    Entry& insert(const TKmer& kmer, uint64_t hash);
+    void eraseslot(size_t i);
+    void grow(size_t minslots);
+};
+
+template <typename F>
+void KmerCountMap::countpacked(const uint8_t *buf, size_t numkmers, F&& keep)
+{
+    constexpr size_t ahead = 8;
+    uint64_t hashes[ahead];
+
+    for (size_t i = 0; i < numkmers + ahead; ++i)
+    {
+        if (i >= ahead)
+        {
+            size_t j = i - ahead;
+            TKmer kmer(buf + j * TKmer::NBYTES);
+
+            if (keep(kmer))
+                insert(kmer, hashes[j % ahead]).increment();
+        }
+
+        if (i < numkmers)
+        {
+            hashes[i % ahead] = TKmer(buf + i * TKmer::NBYTES).GetHash();
+
+            if (!slots.empty())
+            {
+                __builtin_prefetch(&slots[home(hashes[i % ahead])]);
+                __builtin_prefetch(&dists[home(hashes[i % ahead])]);
+            }
+        }
+    }
+}
+
+template <typename P>
+size_t KmerCountMap::eraseif(P&& pred)
+{
+    size_t numerased = 0;
+
+    /*
+     * Erasing slot i shifts the entries after it back by one, so slot i is looked
+     * at again until it holds an entry to keep. An entry that wraps around from
+     * the start of the table can be looked at twice, which is harmless.
+     */
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        while (dists[i] && pred(static_cast<const Entry&>(slots[i])))
+        {
+            eraseslot(i);
+            numerased++;
+        }
+    }
+
+    return numerased;
+}
+
+template <typename F>
+void KmerCountMap::foreachoccurrence(const Entry& entry, F&& f) const
+{
+    for (uint32_t o = entry.offset; o < entry.offset + entry.count; ++o)
+        f(readids[o], positions[o]);
+}
+
+template <typename F>
+void KmerCountMap::foreach(F&& f) const
+{
+    for (size_t i = 0; i < slots.size(); ++i)
+        if (dists[i]) f(static_cast<const Entry&>(slots[i]));
+}
+
+template <typename F>
+void KmerCountMap::foreach(F&& f)
+{
+    for (size_t i = 0; i < slots.size(); ++i)
+        if (dists[i]) f(slots[i]);
+}
+
+#endif
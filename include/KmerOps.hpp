@@ -5,45 +5,88 @@
 #include "Kmer.hpp"
 #include "DnaSeq.hpp"
 #include "DnaBuffer.hpp"
+#include "HpcBuffer.hpp"
+#include "KmerSampling.hpp"
+#include "KmerBounds.hpp"
 #include "HyperLogLog.hpp"
-
-#ifndef MAX_ALLTOALL_MEM
-#define MAX_ALLTOALL_MEM (128ULL * 1024ULL * 1024ULL * 1024ULL)
+#include "KmerCountMap.hpp"
+#include "DistributedFastaData.hpp"
+#include <omp.h>
+#include <limits>
+
+/*
+ * Most memory each of the two lists of k-mer seeds the single-pass counting
+ * mode keeps aside takes, before moving to a temporary file (per processor).
+ */
+#ifndef MAX_SEED_SPILL_MEM
+#define MAX_SEED_SPILL_MEM (1ULL * 1024ULL * 1024ULL * 1024ULL)
 #endif
 
-typedef uint32_t PosInRead;
-typedef  int64_t ReadId;
-
-typedef std::array<PosInRead, UPPER_KMER_FREQ> POSITIONS;
-typedef std::array<ReadId,    UPPER_KMER_FREQ> READIDS;
-
 typedef std::tuple<TKmer, ReadId, PosInRead> KmerSeed;
-typedef std::tuple<READIDS, POSITIONS, int> KmerCountEntry;
-typedef std::unordered_map<TKmer, KmerCountEntry> KmerCountMap;
 
+/*
+ * The rows of the k-mer matrix are the matrix ids of the reads (see DistributedFastaData).
+ */
 std::unique_ptr<CT<PosInRead>::PSpParMat>
-create_kmer_matrix(const DnaBuffer& myreads, const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid);
-
+create_kmer_matrix(const KmerCountMap& kmermap, const DistributedFastaData& dfd, std::shared_ptr<CommGrid> commgrid);
+
+/*
+ * Both passes exchange k-mers in rounds, each of which sends at most about
+ * @batchmem bytes from my processor (see BatchState), or everything at once if 0.
+ * Only the k-mers within @bounds are kept. Automatic @bounds are picked once the
+ * first pass has counted the k-mers, and replaced with the fixed bounds picked.
+ */
 std::unique_ptr<KmerCountMap>
-get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid);
+get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid, KmerBounds& bounds, const KmerSampling& sampling = KmerSampling(), size_t batchmem = 0);
+
+/*
+ * If @hpcreads is given, the k-mers are parsed from the homopolymer-compressed
+ * reads instead (see ForeachKmer() below), but their positions still refer to @myreads.
+ * Both passes must be given the same @sampling and @bounds.
+ */
+void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, const KmerBounds& bounds, const HpcBuffer *hpcreads = nullptr, const KmerSampling& sampling = KmerSampling(), size_t batchmem = 0);
+
+/*
+ * Same result as get_kmer_count_map_keys() followed by get_kmer_count_map_values(),
+ * with a single k-mer exchange: every k-mer is sent once, along with its read id and
+ * position. The owner only counts the k-mers as they arrive, and keeps their seeds
+ * aside (spilling to a temporary file past MAX_SEED_SPILL_MEM): the first occurrence of
+ * every k-mer, and the others until the k-mer is seen more than @bounds.upper times.
+ * Once the counts are known (and automatic @bounds picked), the occurrences of the
+ * k-mers within the bounds are stored. It takes more memory than the two passes, but
+ * parses the reads once less.
+ */
+std::unique_ptr<KmerCountMap>
+get_kmer_count_map_fused(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid, KmerBounds& bounds, const HpcBuffer *hpcreads = nullptr, const KmerSampling& sampling = KmerSampling(), size_t batchmem = 0);
+
+/*
+ * Global histogram of the k-mer counts in @kmermap: the number of k-mers counted i times
+ * for every i < @maxcount, and the number counted @maxcount times or more. Collective.
+ */
+std::vector<int64_t> get_kmer_histogram(const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, int maxcount);
 
-void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid);
 int GetKmerOwner(const TKmer& kmer, int nprocs);
 
+/*
+ * A batch ends once my processor would send more than @maxsendbytes in total,
+ * or more than twice its share of that to a single processor. No limit if 0.
+ */
 struct BatchState
 {
     std::shared_ptr<CommGrid> commgrid;
     size_t mynumreads;
+    size_t maxsendbytes;
     size_t memthreshold;
     size_t mykmerssofar;
     size_t mymaxsending;
+    size_t itembytes; /* bytes sent per k-mer */
     ReadId myreadid;
 
-    BatchState(size_t mynumreads, std::shared_ptr<CommGrid> commgrid) : commgrid(commgrid), mynumreads(mynumreads), memthreshold((MAX_ALLTOALL_MEM / commgrid->GetSize()) << 1), mykmerssofar(0), mymaxsending(0), myreadid(0) {}
+    BatchState(size_t mynumreads, std::shared_ptr<CommGrid> commgrid, size_t itembytes = TKmer::NBYTES, size_t maxsendbytes = 0) : commgrid(commgrid), mynumreads(mynumreads), maxsendbytes(maxsendbytes? maxsendbytes : std::numeric_limits<size_t>::max() >> 2), memthreshold((this->maxsendbytes / commgrid->GetSize()) << 1), mykmerssofar(0), mymaxsending(0), itembytes(itembytes), myreadid(0) {}
 
     bool ReachedThreshold(const size_t len)
     {
-        return (mymaxsending * TKmer::NBYTES >= memthreshold || (mykmerssofar + len) * TKmer::NBYTES >= MAX_ALLTOALL_MEM);
+        return (mymaxsending * itembytes >= memthreshold || (mykmerssofar + len) * itembytes >= maxsendbytes);
     }
 
     bool Finished() const
@@ -80,12 +123,7 @@ struct KmerPartitionHandler
         kmerbuckets[GetKmerOwner(kmer, nprocs)].push_back(kmer);
     }
 
-    void operator()(const TKmer& kmer, BatchState& state, size_t kid)
-    {
-        auto& kmerbucket = kmerbuckets[GetKmerOwner(kmer, nprocs)];
-        kmerbucket.push_back(kmer);
-        state.mymaxsending = std::max(kmerbucket.size(), state.mymaxsending);
-    }
+    size_t bucketsize(int i) const { return kmerbuckets[i].size(); }
 };
 
 struct KmerParserHandler
@@ -100,10 +138,70 @@ struct KmerParserHandler
     {
         kmerseeds[GetKmerOwner(kmer, nprocs)].emplace_back(kmer, static_cast<ReadId>(rid) + readoffset, static_cast<PosInRead>(kid));
     }
+
+    size_t bucketsize(int i) const { return kmerseeds[i].size(); }
 };
 
-template <typename KmerHandler>
-void ForeachKmer(const DnaBuffer& myreads, KmerHandler& handler)
+/*
+ * Calls @f(repmer, position) for every representative k-mer of read @i that
+ * does not overlap a run of Ns and is kept by @sampling, and returns how many
+ * k-mers that was. Since Ns are stored as As, those k-mers would otherwise be
+ * spurious poly-A k-mers.
+ */
+template <typename F>
+size_t ForeachReadKmer(const DnaBuffer& myreads, size_t i, F&& f, const KmerSampling& sampling = KmerSampling())
+{
+    const DnaSeq& sequence = myreads[i];
+    const NRun *nruns = myreads.getnruns(i);
+    size_t numnruns = myreads.getnumnruns(i);
+    size_t numkmers = 0;
+    size_t begin = 0;
+
+    /*
+     * Go through the stretches between consecutive N runs.
+     */
+    for (size_t r = 0; r <= numnruns; ++r)
+    {
+        size_t end = r < numnruns? nruns[r].begin : sequence.size();
+
+        numkmers += sampling.ForeachRepKmer(sequence, begin, end, f);
+
+        if (r < numnruns) begin = nruns[r].end;
+    }
+
+    return numkmers;
+}
+
+/*
+ * Same for read @i of the homopolymer-compressed reads, except that the position
+ * passed to @f is the position in the original read of the first base of the middle
+ * run of the k-mer. Since KMER_SIZE is odd, the middle run of a k-mer is also the
+ * middle run of its reverse complement, so the k-mer has the same anchor on both strands.
+ */
+template <typename F>
+size_t ForeachReadKmer(const HpcBuffer& hpcreads, size_t i, F&& f, const KmerSampling& sampling = KmerSampling())
+{
+    /*
+     * K-mers come in increasing order, so the original positions
+     * of their middle runs are summed up as we go.
+     */
+    size_t run = 0, pos = 0;
+
+    return ForeachReadKmer(hpcreads.getdna(), i, [&](const TKmer& repmer, size_t j)
+    {
+        for (; run < j + KMER_SIZE/2; ++run)
+            pos += hpcreads.getrunlen(i, run);
+
+        f(repmer, pos);
+    }, sampling);
+}
+
+/*
+ * Calls @handler(repmer, position, i) for every k-mer of every local read i. @myreads
+ * can be a DnaBuffer or an HpcBuffer (see ForeachReadKmer() above).
+ */
+template <typename Reads, typename KmerHandler>
+void ForeachKmer(const Reads& myreads, KmerHandler& handler, const KmerSampling& sampling = KmerSampling())
 {
     size_t i;
 
@@ -115,52 +213,102 @@ void ForeachKmer(const DnaBuffer& myreads, KmerHandler& handler)
         /*
          * If it is too small then continue to the next one.
          */
-        if (myreads[i].size() < KMER_SIZE)
+        if (myreads.getreadlen(i) < KMER_SIZE)
             continue;
 
         /*
-         * Get all the representative k-mer seeds.
+         * Go through each representative k-mer seed that isn't masked by an N run.
          */
-        std::vector<TKmer> repmers = TKmer::GetRepKmers(myreads[i]);
+        ForeachReadKmer(myreads, i, [&](const TKmer& repmer, size_t j) { handler(repmer, j, i); }, sampling);
+    }
+}
 
-        size_t j = 0;
+/*
+ * Thread-parallel ForeachKmer() over the reads [@begin, @end), with one handler per
+ * OpenMP thread. Thread t only calls @handlers[t], so the handlers must not share any
+ * mutable state. Every thread gets a contiguous range of reads with about the same
+ * number of bases, and the ranges are in thread order: concatenating what the handlers
+ * collected in thread order gives the same sequence as the serial ForeachKmer().
+ */
+template <typename Reads, typename KmerHandler>
+void ForeachKmer(const Reads& myreads, std::vector<KmerHandler>& handlers, size_t begin, size_t end, const KmerSampling& sampling = KmerSampling())
+{
+    int nthreads = handlers.size();
+    std::vector<size_t> bounds(nthreads+1, end);
+    size_t totbases = 0, bases = 0;
+    int nextbound = 1;
 
-        /*
-         * Go through each k-mer seed.
-         */
-        for (auto meritr = repmers.begin(); meritr != repmers.end(); ++meritr, ++j)
-        {
-            handler(*meritr, j, i);
-        }
+    for (size_t i = begin; i < end; ++i)
+        totbases += myreads.getreadlen(i);
+
+    bounds[0] = begin;
+
+    for (size_t i = begin; i < end && nextbound < nthreads; ++i)
+    {
+        bases += myreads.getreadlen(i);
+
+        while (nextbound < nthreads && bases * nthreads >= totbases * nextbound)
+            bounds[nextbound++] = i + 1;
     }
-}
 
+    #pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    for (int t = 0; t < nthreads; ++t)
+    {
+        KmerHandler& handler = handlers[t];
+
+        for (size_t i = bounds[t]; i < bounds[t+1]; ++i)
+            ForeachReadKmer(myreads, i, [&](const TKmer& repmer, size_t j) { handler(repmer, j, i); }, sampling);
+    }
+}
 
-template <typename KmerHandler>
-void ForeachKmer(const DnaBuffer& myreads, KmerHandler& handler, BatchState& state)
+/*
+ * Parses the next batch of k-mers into the per-thread @handlers (which have to be emptied
+ * after every batch), starting from read state.myreadid, until the batch reaches the
+ * memory threshold or my reads run out.
+ */
+template <typename Reads, typename KmerHandler>
+void ForeachKmer(const Reads& myreads, std::vector<KmerHandler>& handlers, BatchState& state, const KmerSampling& sampling)
 {
-    for (; state.myreadid < static_cast<ReadId>(myreads.size()); state.myreadid++)
+    /*
+     * The threads parse chunks of reads of at most 1/16th of what an ALLTOALL
+     * can hold, so a batch can only overshoot its threshold by that much.
+     */
+    size_t chunkbases = std::max(state.maxsendbytes / state.itembytes / 16, static_cast<size_t>(1));
+
+    size_t numreads = myreads.size();
+    int nprocs = state.commgrid->GetSize();
+
+    state.mykmerssofar = state.mymaxsending = 0;
+
+    while (state.myreadid < static_cast<ReadId>(numreads))
     {
-        const DnaSeq& sequence = myreads[state.myreadid];
+        size_t begin = state.myreadid, end = begin, bases = 0;
 
-        if (sequence.size() < KMER_SIZE)
-            continue;
+        while (end < numreads && bases < chunkbases)
+            bases += myreads.getreadlen(end++);
 
-        std::vector<TKmer> repmers = TKmer::GetRepKmers(sequence);
-        state.mykmerssofar += repmers.size();
+        ForeachKmer(myreads, handlers, begin, end, sampling);
+        state.myreadid = end;
 
-        size_t j = 0;
+        /*
+         * The buckets are emptied after every batch, so they
+         * hold exactly the k-mers of the current batch.
+         */
+        state.mykmerssofar = state.mymaxsending = 0;
 
-        for (auto meritr = repmers.begin(); meritr != repmers.end(); ++meritr, ++j)
+        for (int i = 0; i < nprocs; ++i)
         {
-            handler(*meritr, state, j);
+            size_t sending = 0;
+
+            for (const KmerHandler& handler : handlers)
+                sending += handler.bucketsize(i);
+
+            state.mykmerssofar += sending;
+            state.mymaxsending = std::max(sending, state.mymaxsending);
         }
 
-        if (state.ReachedThreshold(sequence.size()))
-        {
-            state.myreadid++;
+        if (state.ReachedThreshold(myreads.getreadlen(end-1)))
             return;
-        }
     }
 }
 
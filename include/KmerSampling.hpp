@@ -0,0 +1,267 @@
+#ifndef KMER_SAMPLING_H_
+#define KMER_SAMPLING_H_
+
+#include "common.h"
+#include "Kmer.hpp"
+#include "DnaSeq.hpp"
+#include <vector>
+#include <limits>
+
+/*
+ * Which k-mers of a read become seeds. By default every k-mer does. Sampling
+ * keeps a fraction of them, which shrinks both k-mer exchanges and the k-mer
+ * matrix by about the same factor:
+ *
+ *   MINIMIZERS: in every window of @param consecutive k-mers, the k-mer with
+ *   the smallest hash is kept. Density is about 2/(w+1).
+ *
+ *   CLOSED_SYNCMERS: the k-mer is kept if the smallest of its s-mers (s = @param)
+ *   is its first or last one. Density is about 2/(k-s+1).
+ *
+ *   OPEN_SYNCMERS: the k-mer is kept if the smallest of its s-mers is its middle
+ *   one. Density is about 1/(k-s+1).
+ *
+ * On top of that, a @stride larger than one only keeps the k-mers whose hash is
+ * a multiple of @stride, about 1/@stride of them. Picking them by position instead
+ * would keep different k-mers in two reads unless they overlap at a multiple of
+ * @stride, and so lose most of their shared seeds.
+ *
+ * Only canonical k-mers and s-mers are compared, so both strands of a read keep
+ * the same k-mers, and two reads that share a long enough stretch keep the same
+ * k-mers within it. Syncmers are chosen from the k-mer alone, which makes them
+ * less sensitive to nearby sequencing errors than minimizers.
+ */
+struct KmerSampling
+{
+    enum Mode { ALL_KMERS, MINIMIZERS, CLOSED_SYNCMERS, OPEN_SYNCMERS };
+
+    Mode mode;
+    int param; /* window size w for minimizers, s-mer size s for syncmers */
+    int stride;
+
+    KmerSampling(Mode mode = ALL_KMERS, int param = 0, int stride = 1) : mode(mode), param(param), stride(stride) {}
+
+    /*
+     * Empty string if @mode and @param work with KMER_SIZE, the problem otherwise.
+     */
+    std::string Check() const
+    {
+        if (stride < 1)
+            return "k-mer stride must be at least 1";
+
+        if (mode == MINIMIZERS && param < 1)
+            return "minimizer window must be at least 1";
+
+        if (mode == CLOSED_SYNCMERS || mode == OPEN_SYNCMERS)
+        {
+            if (param < 1 || param >= KMER_SIZE || param > 32)
+                return "syncmer s-mer size must be between 1 and min(k-1, 32)";
+
+            /*
+             * The middle s-mer of a k-mer is only the middle s-mer of
+             * its reverse complement too if k-s is even.
+             */
+            if (mode == OPEN_SYNCMERS && (KMER_SIZE - param) % 2)
+                return "open syncmer s-mer size must be odd, like the k-mer size";
+        }
+
+        return "";
+    }
+
+    std::string GetString() const
+    {
+        std::string s;
+
+        switch (mode)
+        {
+            case MINIMIZERS:      s = "(" + std::to_string(param) + "," + std::to_string(KMER_SIZE) + ")-minimizers"; break;
+            case CLOSED_SYNCMERS: s = "closed syncmers (s=" + std::to_string(param) + ")"; break;
+            case OPEN_SYNCMERS:   s = "open syncmers (s=" + std::to_string(param) + ")"; break;
+            default:              s = "all k-mers"; break;
+        }
+
+        if (stride > 1) s += " at stride " + std::to_string(stride);
+
+        return s;
+    }
+
+    /*
+     * Same as TKmer::ForeachRepKmer(), except that only the sampled k-mers are
+     * passed to @f. Returns how many that was.
+     */
+    template <typename F>
+    size_t ForeachRepKmer(const DnaSeq& s, size_t begin, size_t end, F&& f) const;
+
+    /*
+     * Hash used to order k-mers and s-mers (the MurmurHash3 finalizer). It must not
+     * be TKmer::GetHash(), which assigns k-mers to processors: the sampled k-mers
+     * would all have small hashes and go to the first few processors.
+     */
+    static uint64_t Order(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t Order(const TKmer& kmer)
+    {
+        uint64_t words[TKmer::NBYTES / 8], h = 0;
+        kmer.CopyDataInto(words);
+
+        for (uint64_t word : words)
+            h = Order(h ^ word);
+
+        return h;
+    }
+};
+
+/*
+ * The smallest hash within a window of the last @w items pushed, leftmost on ties.
+ * The minimum is only rescanned when it slides out of the window, which for
+ * random hashes happens about once every w/2 items.
+ */
+template <typename T>
+class WindowMinimum
+{
+public:
+    WindowMinimum(size_t w) : w(w), hashes(w), items(w), count(0), minidx(0) {}
+
+    void Push(uint64_t hash, const T& item)
+    {
+        size_t idx = count++;
+
+        hashes[idx % w] = hash;
+        items[idx % w] = item;
+
+        if (idx == 0 || hash < hashes[minidx % w])
+            minidx = idx;
+        else if (minidx + w <= idx)
+            rescan();
+    }
+
+    size_t Count() const { return count; }
+    size_t MinIndex() const { return minidx; }
+    const T& MinItem() const { return items[minidx % w]; }
+    uint64_t MinHash() const { return hashes[minidx % w]; }
+
+    /*
+     * Hash of item @idx, which must still be in the window.
+     */
+    uint64_t GetHash(size_t idx) const { return hashes[idx % w]; }
+
+private:
+    size_t w;
+    std::vector<uint64_t> hashes;
+    std::vector<T> items;
+    size_t count, minidx;
+
+    void rescan()
+    {
+        minidx = count - w;
+
+        for (size_t idx = minidx + 1; idx < count; ++idx)
+            if (hashes[idx % w] < hashes[minidx % w])
+                minidx = idx;
+    }
+};
+
+template <typename F>
+size_t KmerSampling::ForeachRepKmer(const DnaSeq& s, size_t begin, size_t end, F&& f) const
+{
+    if (end < begin + KMER_SIZE)
+        return 0;
+
+    size_t numkmers = end - begin - KMER_SIZE + 1;
+    size_t numsampled = 0;
+
+    auto emit = [&](const TKmer& repmer, size_t i)
+    {
+        if (stride == 1 || Order(repmer) % stride == 0)
+        {
+            f(repmer, i);
+            numsampled++;
+        }
+    };
+
+    if (mode == MINIMIZERS)
+    {
+        /*
+         * A stretch shorter than a window still gets its smallest k-mer.
+         */
+        size_t w = std::min(static_cast<size_t>(param), numkmers);
+        size_t lastpicked = std::numeric_limits<size_t>::max();
+        WindowMinimum<TKmer> window(w);
+
+        TKmer::ForeachRepKmer(s, begin, end, [&](const TKmer& repmer, size_t i)
+        {
+            window.Push(Order(repmer), repmer);
+
+            if (window.Count() >= w && window.MinIndex() != lastpicked)
+            {
+                lastpicked = window.MinIndex();
+                emit(window.MinItem(), begin + lastpicked);
+            }
+        });
+    }
+    else if (mode == CLOSED_SYNCMERS || mode == OPEN_SYNCMERS)
+    {
+        /*
+         * The canonical s-mers are rolled along one nucleotide ahead of the
+         * k-mers: when k-mer i comes, its last s-mer i+k-s is pushed and the
+         * window holds exactly its k-s+1 s-mers. The smallest s-mer can appear
+         * more than once (e.g. in low complexity sequence), so the k-mer is kept
+         * if any of the positions that count has the smallest hash. That keeps
+         * the choice the same on both strands.
+         */
+        int smer = param;
+        size_t w = KMER_SIZE - smer + 1;
+        uint64_t mask = smer < 32? (1ULL << (2*smer)) - 1 : ~0ULL;
+        uint64_t fwd = 0, rev = 0;
+        size_t next = begin;
+        WindowMinimum<char> window(w);
+
+        auto pushsmer = [&]()
+        {
+            for (; next < begin + window.Count() + smer; ++next)
+            {
+                uint64_t code = s[next];
+                fwd = ((fwd << 2) | code) & mask;
+                rev = (rev >> 2) | ((3 - code) << (2*smer - 2));
+            }
+
+            window.Push(Order(std::min(fwd, rev)), 0);
+        };
+
+        while (window.Count() + 1 < w)
+            pushsmer();
+
+        TKmer::ForeachRepKmer(s, begin, end, [&](const TKmer& repmer, size_t i)
+        {
+            pushsmer();
+
+            size_t first = i - begin, last = first + w - 1;
+            uint64_t minhash = window.MinHash();
+
+            if (mode == CLOSED_SYNCMERS? (window.GetHash(first) == minhash || window.GetHash(last) == minhash)
+                                       : (window.GetHash(first + (w-1)/2) == minhash))
+                emit(repmer, i);
+        });
+    }
+    else if (stride > 1)
+    {
+        TKmer::ForeachRepKmer(s, begin, end, emit);
+    }
+    else
+    {
+        TKmer::ForeachRepKmer(s, begin, end, f);
+        numsampled = numkmers;
+    }
+
+    return numsampled;
+}
+
+#endif
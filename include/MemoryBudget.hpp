@@ -0,0 +1,53 @@
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include <mpi.h>
+#include <cstddef>
+
+/*
+ * How much memory each process can use, worked out at runtime from the memory
+ * available on its node (MemAvailable in /proc/meminfo), the number of processes
+ * sharing that node, and an optional cap on the memory used per node. Every process
+ * gets the same budget, that of the most crowded node.
+ *
+ * Phases are bracketed like with MPITimer, and stop_and_log() reports the peak
+ * memory of every process during the phase (VmHWM in /proc/self/status). Only a
+ * phase that sizes its buffers from the budget is started with start_with_budget(),
+ * which hands it whatever is left of the budget after what the process already
+ * holds (getphasebudget()), and its peak is reported against that.
+ */
+class MemoryBudget
+{
+public:
+    /*
+     * Collective over @comm. If @nodecapmb is positive, processes on a node
+     * use at most that many megabytes together, even if more is available.
+     */
+    MemoryBudget(MPI_Comm comm, size_t nodecapmb = 0);
+
+    size_t getbudget() const { return budget; }
+    size_t getphasebudget() const { return phasebudget; }
+    int getranksonnode() const { return ranksonnode; }
+    size_t getnodeavailable() const { return nodeavailable; }
+
+    void start();
+    void start_with_budget();
+    void stop_and_log(char const *label);
+
+    /*
+     * Memory figures of this process in bytes, or 0 if the system doesn't say.
+     */
+    static size_t getresident(); /* VmRSS */
+    static size_t getpeak();     /* VmHWM */
+
+private:
+    MPI_Comm comm;
+    bool isroot;
+    int ranksonnode;      /* most processes on any one node */
+    size_t nodeavailable; /* least memory available on any one node */
+    size_t budget;
+    size_t phasebudget;   /* 0 if the phase was started without a budget */
+    bool canresetpeak;    /* whether VmHWM can be reset between phases */
+};
+
+#endif
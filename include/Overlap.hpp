@@ -16,7 +16,10 @@ struct Overlap
     operator int() const { return 1; } /* for creating integer matrix with same nonzero pattern */
     operator int64_t() const { return static_cast<int64_t>(1); } /* ditto */
 
-    void extend_overlap(const DnaSeq& seqQ, const DnaSeq& seqT, int mat, int mis, int gap, int dropoff);
+    /*
+     * If @hpcseed is set, @seed holds the anchors of a homopolymer-compressed k-mer (see xdrop_anchor_aligner()).
+     */
+    void extend_overlap(const DnaSeq& seqQ, const DnaSeq& seqT, int mat, int mis, int gap, int dropoff, bool hpcseed = false);
     void classify();
 
     std::tuple<PosInRead, PosInRead> beg, end, len;
@@ -6,7 +6,10 @@
 #include "SharedSeeds.hpp"
 #include "Overlap.hpp"
 
+/*
+ * @hpcseeds says whether the seeds in @Bmat come from homopolymer-compressed k-mers.
+ */
 std::unique_ptr<CT<Overlap>::PSpParMat>
-PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, int mat, int mis, int gap, int dropoff);
+PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, int mat, int mis, int gap, int dropoff, bool hpcseeds = false);
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef READ_NAMES_H_
+#define READ_NAMES_H_
+
+#include "common.h"
+#include "FastaIndex.hpp"
+#include <string_view>
+
+/*
+ * Read names stay distributed across the processors that own the reads. ReadNames
+ * fetches only the names a processor asks for from their owners, and caches them
+ * in one flat buffer so that a name is never fetched twice.
+ */
+class ReadNames
+{
+public:
+    ReadNames(const FastaIndex& index) : index(index), nameoffsets(1, 0) {}
+
+    /*
+     * Make sure the names of the reads with global ids @readids are cached. This is
+     * collective, even for processors that don't need any names. @readids can be
+     * unsorted and have duplicates.
+     */
+    void fetch(std::vector<size_t> readids);
+
+    /*
+     * Name of the read with global id @readid, which must have been fetched.
+     */
+    std::string_view operator[](size_t readid) const;
+
+    size_t size() const { return cachedids.size(); }
+
+private:
+    const FastaIndex& index;
+    std::vector<size_t> cachedids; /* sorted global ids of the cached names */
+    std::vector<size_t> nameoffsets; /* name of read cachedids[i] is namebuf[nameoffsets[i]..nameoffsets[i+1]) */
+    std::vector<char> namebuf;
+};
+
+#endif
@@ -26,6 +26,13 @@ struct XSeed
 };
 
 int xdrop_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int begQ, int begT, int mat, int mis, int gap, int dropoff, XSeed& result);
+
+/*
+ * Same, but for seeds from homopolymer-compressed k-mers, which only match exactly
+ * after compression. @anchorQ and @anchorT are the first bases of the same run
+ * in both reads, and the alignment is extended from the bases that run has in common.
+ */
+int xdrop_anchor_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int anchorQ, int anchorT, int mat, int mis, int gap, int dropoff, XSeed& result);
 void classify_alignment(const XSeed& ai, int lenQ, int lenT, OverlapClass& kind);
 
 #endif
@@ -44,7 +44,11 @@ using MPI_Displ_type = MPI_Aint;
 #define MPI_SEND             MPI_FUNC_SELECT(MPI_Send)
 #define MPI_ISEND            MPI_FUNC_SELECT(MPI_Isend)
 #define MPI_IRECV            MPI_FUNC_SELECT(MPI_Irecv)
+#define MPI_FILE_READ_AT     MPI_FUNC_SELECT(MPI_File_read_at)
 #define MPI_FILE_READ_AT_ALL MPI_FUNC_SELECT(MPI_File_read_at_all)
+#define MPI_FILE_IREAD_AT_ALL MPI_FUNC_SELECT(MPI_File_iread_at_all)
+#define MPI_FILE_WRITE_AT_ALL MPI_FUNC_SELECT(MPI_File_write_at_all)
+#define MPI_FILE_WRITE_ORDERED MPI_FUNC_SELECT(MPI_File_write_ordered)
 
 #ifndef MPI_SIZE_T
 static_assert(std::numeric_limits<size_t>::max() == std::numeric_limits<unsigned long>::max());
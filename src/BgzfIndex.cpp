@@ -0,0 +1,197 @@
+#include "BgzfIndex.hpp"
+#include <zlib.h>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+static inline uint16_t getle16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t getle32(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+/*
+ * Every BGZF block starts with a gzip header whose extra field holds
+ * a "BC" subfield with the total block size minus one.
+ */
+static constexpr size_t bgzf_header_size = 18;
+static constexpr size_t bgzf_footer_size = 8; /* CRC32 and ISIZE */
+
+static size_t getbgzfblocksize(const unsigned char *header)
+{
+    return static_cast<size_t>(getle16(header + 16)) + 1;
+}
+
+bool BgzfIndex::isbgzf(const std::string& fname)
+{
+    unsigned char header[bgzf_header_size];
+    std::ifstream filestream(fname, std::ios::binary);
+
+    if (!filestream.read(reinterpret_cast<char*>(header), bgzf_header_size))
+        return false;
+
+    return header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4) &&
+           getle16(header + 10) == 6 && header[12] == 'B' && header[13] == 'C' && getle16(header + 14) == 2;
+}
+
+BgzfIndex::BgzfIndex(const std::string& bgzf_fname, MPI_Offset ustart, MPI_Offset uend) : bgzf_fname(bgzf_fname)
+{
+    MPI_File gzifh, fh;
+    MPI_Offset cfilesize;
+
+    /*
+     * Processors load different parts of the index with independent reads,
+     * so the files are opened on MPI_COMM_SELF.
+     */
+    MPI_File_open(MPI_COMM_SELF, get_gzi_fname().c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &gzifh);
+    MPI_File_open(MPI_COMM_SELF, bgzf_fname.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_get_size(fh, &cfilesize);
+
+    /*
+     * The .gzi file is a little-endian uint64_t count n followed by n pairs of
+     * uint64_t (compressed offset, uncompressed offset), one for each block after
+     * the first. The first block always starts at (0, 0).
+     */
+    uint64_t numentries;
+    MPI_File_read_at(gzifh, 0, &numentries, 1, MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+    auto getentry = [&](uint64_t k, MPI_Offset& coffset, MPI_Offset& uoffset)
+    {
+        uint64_t entry[2] = {0, 0};
+
+        if (k > 0)
+            MPI_File_read_at(gzifh, 8 + 16 * (k-1), entry, 2, MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+        coffset = static_cast<MPI_Offset>(entry[0]);
+        uoffset = static_cast<MPI_Offset>(entry[1]);
+    };
+
+    /*
+     * The uncompressed size is the start of the last block plus
+     * the uncompressed size (ISIZE) stored in that block's footer.
+     */
+    MPI_Offset lastcoffset, lastuoffset;
+    getentry(numentries, lastcoffset, lastuoffset);
+    usize = lastuoffset;
+
+    if (lastcoffset < cfilesize)
+    {
+        unsigned char header[bgzf_header_size], footer[bgzf_footer_size];
+        MPI_File_read_at(fh, lastcoffset, header, bgzf_header_size, MPI_UNSIGNED_CHAR, MPI_STATUS_IGNORE);
+        MPI_File_read_at(fh, lastcoffset + getbgzfblocksize(header) - bgzf_footer_size, footer, bgzf_footer_size, MPI_UNSIGNED_CHAR, MPI_STATUS_IGNORE);
+        usize += getle32(footer + 4);
+    }
+
+    MPI_File_close(&fh);
+
+    if (ustart < uend)
+    {
+        MPI_Offset coffset, uoffset;
+
+        /*
+         * Binary search for @first, the last block starting at or before @ustart,
+         * and for @last, the first block starting at or after @uend (numentries+1
+         * stands for the end of the file).
+         */
+        uint64_t lo = 0, hi = numentries;
+
+        while (lo < hi)
+        {
+            uint64_t mid = lo + (hi - lo + 1) / 2;
+            getentry(mid, coffset, uoffset);
+            if (uoffset <= ustart) lo = mid;
+            else hi = mid - 1;
+        }
+
+        uint64_t first = lo;
+
+        lo = first, hi = numentries + 1;
+
+        while (lo < hi)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+            getentry(mid, coffset, uoffset);
+            if (uoffset >= uend) hi = mid;
+            else lo = mid + 1;
+        }
+
+        uint64_t last = lo;
+
+        /*
+         * Load the entries [first..last) with one read, then the end of the last of them.
+         */
+        std::vector<uint64_t> entries(2 * (last - first));
+
+        if (first == 0)
+        {
+            entries[0] = entries[1] = 0;
+            if (last > 1) MPI_File_read_at(gzifh, 8, entries.data() + 2, static_cast<int>(entries.size() - 2), MPI_UINT64_T, MPI_STATUS_IGNORE);
+        }
+        else
+        {
+            MPI_File_read_at(gzifh, 8 + 16 * (first-1), entries.data(), static_cast<int>(entries.size()), MPI_UINT64_T, MPI_STATUS_IGNORE);
+        }
+
+        for (size_t i = 0; i < entries.size(); i += 2)
+        {
+            coffsets.push_back(static_cast<MPI_Offset>(entries[i]));
+            uoffsets.push_back(static_cast<MPI_Offset>(entries[i+1]));
+        }
+
+        if (last <= numentries) getentry(last, coffset, uoffset);
+        else coffset = cfilesize, uoffset = usize;
+
+        coffsets.push_back(coffset);
+        uoffsets.push_back(uoffset);
+    }
+
+    MPI_File_close(&gzifh);
+}
+
+void BgzfIndex::getblockrange(MPI_Offset ustart, MPI_Offset uend, MPI_Offset& cstart, MPI_Offset& cend, MPI_Offset& blockstart, MPI_Offset& blockend) const
+{
+    assert(!uoffsets.empty() && uoffsets.front() <= ustart && uend <= uoffsets.back());
+
+    size_t i = std::upper_bound(uoffsets.begin(), uoffsets.end(), ustart) - uoffsets.begin() - 1;
+    size_t j = std::lower_bound(uoffsets.begin() + i, uoffsets.end(), uend) - uoffsets.begin();
+
+    cstart = coffsets[i], cend = coffsets[j];
+    blockstart = uoffsets[i], blockend = uoffsets[j];
+}
+
+size_t BgzfIndex::inflateblocks(const char *src, size_t srclen, char *dst, size_t dstlen)
+{
+    const unsigned char *block = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char *srcend = block + srclen;
+    size_t written = 0;
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    inflateInit2(&zs, -15); /* raw deflate data, the gzip header and footer are skipped by hand */
+
+    while (block + bgzf_header_size <= srcend)
+    {
+        size_t blocksize = getbgzfblocksize(block);
+        size_t isize = getle32(block + blocksize - 4);
+
+        assert(block + blocksize <= srcend && written + isize <= dstlen);
+
+        zs.next_in = const_cast<unsigned char*>(block + bgzf_header_size);
+        zs.avail_in = static_cast<uInt>(blocksize - bgzf_header_size - bgzf_footer_size);
+        zs.next_out = reinterpret_cast<unsigned char*>(dst + written);
+        zs.avail_out = static_cast<uInt>(isize);
+
+        if (inflate(&zs, Z_FINISH) != Z_STREAM_END)
+        {
+            std::cerr << "error: corrupted BGZF block: " << (zs.msg? zs.msg : "inflate failed") << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        inflateReset(&zs);
+        written += isize;
+        block += blocksize;
+    }
+
+    inflateEnd(&zs);
+
+    return written;
+}
@@ -140,13 +140,27 @@ std::vector<int64_t> ImposeMyReadDistribution(CT<int64_t>::PDistVec& assignments
     int64_t orig_size = assignments.LocArrSize();
 
     std::vector<int64_t> orig_vector = assignments.GetLocVec();
+    std::vector<int64_t> send_vector;
 
     std::vector<int> sendcounts(nprocs, 0);
     std::vector<int> recvcounts(nprocs);
 
+    send_vector.reserve(orig_size);
+
+    /*
+     * @assignments is indexed by matrix ids, so the empty ids that pad the
+     * grid rows are dropped (see DistributedFastaData). The matrix ids of the
+     * reads are in read order, so the owners still get their reads in order.
+     */
     for (int64_t i = 0; i < orig_size; ++i)
     {
-        int owner = index.getreadowner(i+orig_offset);
+        int64_t readid = dfd.getreadid(i+orig_offset);
+
+        if (readid < 0)
+            continue;
+
+        int owner = index.getreadowner(readid);
+        send_vector.push_back(orig_vector[i]);
         ++sendcounts[owner];
     }
 
@@ -162,11 +176,42 @@ std::vector<int64_t> ImposeMyReadDistribution(CT<int64_t>::PDistVec& assignments
 
     std::vector<int64_t> new_vector(totrecv);
 
-    MPI_Alltoallv(orig_vector.data(), sendcounts.data(), sdispls.data(), MPI_INT64_T, new_vector.data(), recvcounts.data(), rdispls.data(), MPI_INT64_T, comm);
+    MPI_Alltoallv(send_vector.data(), sendcounts.data(), sdispls.data(), MPI_INT64_T, new_vector.data(), recvcounts.data(), rdispls.data(), MPI_INT64_T, comm);
 
     return new_vector;
 }
 
+/*
+ * The other way around: the values @local_values of my reads are laid out by matrix id,
+ * with @fill at the empty ids that pad the grid rows, so that a distributed vector built
+ * from the result matches the matrices (see DistributedFastaData). Each processor pads
+ * after its reads, and the first processor also pads before them.
+ */
+std::vector<int64_t> ImposeMatrixDistribution(const std::vector<int64_t>& local_values, int64_t fill, DistributedFastaData& dfd)
+{
+    auto index = dfd.getindex();
+    auto commgrid = index.getcommgrid();
+    int64_t myreaddispl = index.getmyreaddispl();
+    int64_t numreads = index.gettotrecords();
+    int64_t nlocreads = local_values.size();
+
+    std::vector<int64_t> matrix_values;
+
+    if (commgrid->GetRank() == 0)
+        matrix_values.resize(numreads > 0? dfd.getmatrixid(0) : dfd.getmatrixdim(), fill);
+
+    for (int64_t i = 0; i < nlocreads; ++i)
+    {
+        int64_t readid = i + myreaddispl;
+        int64_t nextid = readid+1 < numreads? dfd.getmatrixid(readid+1) : static_cast<int64_t>(dfd.getmatrixdim());
+
+        matrix_values.push_back(local_values[i]);
+        matrix_values.resize(matrix_values.size() + (nextid - dfd.getmatrixid(readid) - 1), fill);
+    }
+
+    return matrix_values;
+}
+
 std::vector<int64_t> GetLocalProcAssignments(CT<int64_t>::PDistVec& assignments, std::vector<std::tuple<int64_t, int64_t>>& contigsizes, DistributedFastaData& dfd)
 {
     auto index = dfd.getindex();
@@ -264,7 +309,7 @@ std::unordered_map<int64_t, std::string> GetInducedReadSequences(const std::vect
             char_totsend += mydna[i].size();
             char_sendcnts[dest] += mydna[i].size();
 
-            globalid_buckets[dest].push_back(i + myreaddispl);
+            globalid_buckets[dest].push_back(i);
         }
     }
 
@@ -293,15 +338,18 @@ std::unordered_map<int64_t, std::string> GetInducedReadSequences(const std::vect
     globalid_sendbuf.reserve(item_totsend);
     globalid_recvbuf.resize(item_totrecv);
 
+    /*
+     * The reads are looked up by their matrix ids, like the vertices of the string graph.
+     */
     for (auto itr = globalid_buckets.begin(); itr != globalid_buckets.end(); ++itr)
     {
-        globalid_sendbuf.insert(globalid_sendbuf.end(), itr->begin(), itr->end());
-
         for (size_t i = 0; i < itr->size(); ++i)
         {
-            int64_t localid = (*itr)[i] - myreaddispl;
+            int64_t localid = (*itr)[i];
             auto seq = mydna[localid].ascii();
 
+            globalid_sendbuf.push_back(dfd.getmatrixid(localid + myreaddispl));
+
             char_sendbuf.insert(char_sendbuf.end(), seq.begin(), seq.end());
             readlen_sendbuf.push_back(seq.size());
         }
@@ -370,9 +418,9 @@ std::vector<std::string> GenerateContigs(CT<Overlap>::PSpParMat& S, const DnaBuf
      */
     std::vector<int64_t> local_proc_assignments = GetLocalProcAssignments(assignments, contigsizes, dfd);
 
-    CT<int64_t>::PDistVec proc_assignments(local_proc_assignments, commgrid);
+    CT<int64_t>::PDistVec proc_assignments(ImposeMatrixDistribution(local_proc_assignments, -1, dfd), commgrid);
 
-    std::vector<int64_t> local_contig_read_ids; /* mapping of local graph indices (`contig_chains`) to original global read indices. */
+    std::vector<int64_t> local_contig_read_ids; /* mapping of local graph indices (`contig_chains`) to original global matrix ids. */
     CT<Overlap>::PSpDCCols contig_chains_derived = S.InducedSubgraphs2Procs(proc_assignments, local_contig_read_ids);
     CT<Overlap>::PSpCCols contig_chains(contig_chains_derived);
     contig_chains.Transpose();
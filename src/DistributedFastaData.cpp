@@ -2,37 +2,238 @@
 #include "Logger.hpp"
 #include <limits>
 #include <iomanip>
+#include <numeric>
+#include <algorithm>
 
-DistributedFastaData::DistributedFastaData(FastaIndex& index) : index(index)
+DistributedFastaData::DistributedFastaData(FastaIndex& index, bool sharedstore) : index(index), sharedstore(sharedstore)
 {
     std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
 
     assert(commgrid->GetGridRows() == commgrid->GetGridCols());
 
+    int myrowid = commgrid->GetRankInProcCol();
+    int mycolid = commgrid->GetRankInProcRow();
+
+    isdiag = (myrowid == mycolid);
+
+    setupdimranges();
+
+    getdimrange(myrowid, rowinfo.startid, rowinfo.numreads);
+    getdimrange(mycolid, colinfo.startid, colinfo.numreads);
+
+    rowinfo.matrixstartid = myrowid * dimsize;
+    colinfo.matrixstartid = mycolid * dimsize;
+
+    if (sharedstore) setupsharedstore();
+
+    #if LOG_LEVEL >= 2
+    Logger logger(commgrid);
+    logger() << "P(" << myrowid+1 << ", " << mycolid+1 << ") " << Logger::readrangestr(rowinfo.startid, rowinfo.numreads) << "; " << Logger::readrangestr(colinfo.startid, colinfo.numreads);
+    logger.Flush("2D processor grid sequence distribution");
+
+    if (sharedstore)
+    {
+        int myrank = commgrid->GetRank();
+        int rowshmsize, colshmsize = 0;
+        MPI_Comm_size(rowinfo.shmcomm, &rowshmsize);
+        if (colinfo.shmcomm != MPI_COMM_NULL) MPI_Comm_size(colinfo.shmcomm, &colshmsize);
+
+        logger() << "P(" << myrowid+1 << ", " << mycolid+1 << ") grid row reads shared by " << rowshmsize << " processors" << (requestsdim(myrank, 0)? " (receiving)" : "")
+                 << ", grid column reads shared by " << colshmsize << " processors" << (requestsdim(myrank, 1)? " (receiving)" : "");
+        logger.Flush("Node shared memory sequence store:");
+    }
+
+    logpredictedwork();
+    #endif
+}
+
+DistributedFastaData::~DistributedFastaData()
+{
+    for (DimExchangeInfo *diminfo : {&rowinfo, &colinfo})
+    {
+        if (diminfo->shmwin != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(diminfo->shmwin);
+            MPI_Win_free(&diminfo->shmwin);
+        }
+
+        if (diminfo->shmcomm != MPI_COMM_NULL)
+            MPI_Comm_free(&diminfo->shmcomm);
+    }
+}
+
+void DistributedFastaData::setupsharedstore()
+{
+    std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
+    MPI_Comm comm = commgrid->GetWorld();
     int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
+    int myrowid = commgrid->GetRankInProcCol();
+    int mycolid = commgrid->GetRankInProcRow();
+
+    /*
+     * The processors on my node that are in my grid row share one copy of the
+     * row reads, and the same goes for my grid column. The lowest ranked
+     * processor of each group receives the reads on behalf of the group.
+     */
+    MPI_Comm nodecomm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myrank, MPI_INFO_NULL, &nodecomm);
+    MPI_Comm_split(nodecomm, myrowid, myrank, &rowinfo.shmcomm);
+    MPI_Comm_split(nodecomm, mycolid, myrank, &colinfo.shmcomm);
+    MPI_Comm_free(&nodecomm);
+
+    int rowshmrank, colshmrank, colshmsize;
+    MPI_Comm_rank(rowinfo.shmcomm, &rowshmrank);
+    MPI_Comm_rank(colinfo.shmcomm, &colshmrank);
+    MPI_Comm_size(colinfo.shmcomm, &colshmsize);
+
+    /*
+     * A diagonal processor that is alone in its column group has no one to share
+     * its column reads with, so it aliases its row reads just like without the
+     * shared store.
+     */
+    if (isdiag && colshmsize == 1)
+        MPI_Comm_free(&colinfo.shmcomm);
+
+    /*
+     * The owners of the reads have to know who requests them.
+     */
+    int mymask = (rowshmrank == 0? 1 : 0) | (colinfo.shmcomm != MPI_COMM_NULL && colshmrank == 0? 2 : 0);
+
+    dimrequesters.resize(nprocs);
+    MPI_ALLGATHER(&mymask, 1, MPI_INT, dimrequesters.data(), 1, MPI_INT, comm);
+}
+
+bool DistributedFastaData::requestsdim(int rank, unsigned short rc) const
+{
+    int procdim = index.getcommgrid()->GetGridRows();
+
+    /*
+     * Without the shared store every processor requests its grid row, and
+     * every processor except the diagonal ones requests its grid column.
+     */
+    if (dimrequesters.empty())
+        return rc == 0 || rank / procdim != rank % procdim;
+
+    return (dimrequesters[rank] >> rc) & 1;
+}
+
+void DistributedFastaData::setupdimranges()
+{
+    std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
+    MPI_Comm comm = commgrid->GetWorld();
+    int procdim = commgrid->GetGridRows();
+
+    /*
+     * The alignment work of grid block (r, c) grows with the number of k-mers in
+     * grid row r times the number in grid column c (see logpredictedwork()), so every
+     * grid row/column gets a contiguous range of reads holding about 1/procdim of
+     * the k-mers. Read i goes to the grid row whose share of the k-mers contains the
+     * middle of the k-mers of read i, which only takes a prefix sum of the k-mer
+     * counts. As in the read partition, the boundaries are then moved so that every
+     * grid row gets at least one read. Without any k-mers, the reads are split by count.
+     */
+    std::vector<size_t> mykmers = index.getmyreadlens();
+    std::transform(mykmers.begin(), mykmers.end(), mykmers.begin(), [](size_t len) { return len >= KMER_SIZE? len - KMER_SIZE + 1 : 0; });
+
+    size_t mytotkmers = std::accumulate(mykmers.begin(), mykmers.end(), static_cast<size_t>(0));
+    size_t kmersbefore = 0, totkmers;
+
+    MPI_ALLREDUCE(&mytotkmers, &totkmers, 1, MPI_SIZE_T, MPI_SUM, comm);
+
+    if (totkmers == 0)
+    {
+        std::fill(mykmers.begin(), mykmers.end(), 1);
+        mytotkmers = mykmers.size();
+        totkmers = index.gettotrecords();
+    }
+
+    MPI_Exscan(&mytotkmers, &kmersbefore, 1, MPI_SIZE_T, MPI_SUM, comm);
+    if (commgrid->GetRank() == 0) kmersbefore = 0;
+
+    std::vector<MPI_Count_type> dimcounts(procdim, 0);
+
+    for (size_t i = 0; i < mykmers.size(); ++i)
+    {
+        int dimid = static_cast<int>(std::min(static_cast<size_t>(procdim-1), ((2*kmersbefore + mykmers[i]) * procdim) / (2*totkmers)));
+        dimcounts[dimid]++;
+        kmersbefore += mykmers[i];
+    }
+
+    MPI_ALLREDUCE(MPI_IN_PLACE, dimcounts.data(), procdim, MPI_COUNT_TYPE, MPI_SUM, comm);
+    FastaIndex::ensure_nonempty_partition(dimcounts);
+
+    dimdispls.assign(procdim+1, 0);
+    std::inclusive_scan(dimcounts.begin(), dimcounts.end(), dimdispls.begin() + 1, std::plus<size_t>{}, static_cast<size_t>(0));
+    dimsize = static_cast<size_t>(*std::max_element(dimcounts.begin(), dimcounts.end()));
+}
+
+void DistributedFastaData::logpredictedwork() const
+{
+    std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
     MPI_Comm comm = commgrid->GetWorld();
 
     int myrowid = commgrid->GetRankInProcCol();
     int mycolid = commgrid->GetRankInProcRow();
     int procdim = commgrid->GetGridRows();
 
-    size_t numreads = index.gettotrecords();
-    size_t readsperprocdim = numreads / procdim;
+    /*
+     * A read of length L contributes L-k+1 k-mers, and the number of candidate
+     * overlaps in grid block (r, c) grows with the number of k-mers in grid row r
+     * times the number in grid column c. Since every block aligns only its local
+     * upper triangle, we use that product as the predicted alignment work of a
+     * block. The k-mer weight of each grid row/column is summed over my local
+     * reads first and then across all processors. What is left of the imbalance
+     * comes from splitting the grid rows/columns at read boundaries.
+     */
+    std::vector<double> dimkmers(procdim, 0.0);
+    std::vector<size_t> myreadlens = index.getmyreadlens();
+    size_t myreaddispl = index.getmyreaddispl();
 
-    isdiag = (myrowid == mycolid);
+    for (size_t i = 0; i < myreadlens.size(); ++i)
+    {
+        int dimid = static_cast<int>(std::upper_bound(dimdispls.cbegin(), dimdispls.cend(), myreaddispl + i) - dimdispls.cbegin()) - 1;
+        dimkmers[dimid] += myreadlens[i] >= KMER_SIZE? myreadlens[i] - KMER_SIZE + 1 : 0;
+    }
 
-    rowinfo.startid = myrowid * readsperprocdim;
-    colinfo.startid = mycolid * readsperprocdim;
+    MPI_ALLREDUCE(MPI_IN_PLACE, dimkmers.data(), procdim, MPI_DOUBLE, MPI_SUM, comm);
 
-    rowinfo.numreads = (myrowid == procdim-1)? (numreads - myrowid*readsperprocdim) : readsperprocdim;
-    colinfo.numreads = (mycolid == procdim-1)? (numreads - mycolid*readsperprocdim) : readsperprocdim;
+    double totkmers = std::accumulate(dimkmers.begin(), dimkmers.end(), 0.0);
+    double avgwork = (totkmers * totkmers) / (static_cast<double>(procdim) * procdim);
+    double mywork = dimkmers[myrowid] * dimkmers[mycolid];
+    double myratio = avgwork > 0? mywork / avgwork : 1.0;
+    double maxratio, minratio;
+
+    MPI_ALLREDUCE(&myratio, &maxratio, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_ALLREDUCE(&myratio, &minratio, 1, MPI_DOUBLE, MPI_MIN, comm);
 
-    #if LOG_LEVEL >= 2
     Logger logger(commgrid);
-    logger() << "P(" << myrowid+1 << ", " << mycolid+1 << ") " << Logger::readrangestr(rowinfo.startid, rowinfo.numreads) << "; " << Logger::readrangestr(colinfo.startid, colinfo.numreads);
-    logger.Flush("2D processor grid sequence distribution");
-    #endif
+    logger() << "P(" << myrowid+1 << ", " << mycolid+1 << ") " << std::fixed << std::setprecision(3) << myratio << "x the average predicted alignment work";
+    if (myratio == maxratio) logger() << " (most loaded)";
+    logger.Flush("Predicted alignment work per 2D grid block:");
+
+    if (commgrid->GetRank() == 0)
+        std::cout << "predicted alignment imbalance (max/avg): " << std::fixed << std::setprecision(3) << maxratio << ", least loaded block: " << minratio << "x the average" << std::endl;
+}
+
+void DistributedFastaData::getdimrange(int dimid, size_t& startid, size_t& numreads) const
+{
+    startid = dimdispls[dimid];
+    numreads = dimdispls[dimid+1] - dimdispls[dimid];
+}
+
+int64_t DistributedFastaData::getmatrixid(size_t readid) const
+{
+    int dimid = static_cast<int>(std::upper_bound(dimdispls.cbegin(), dimdispls.cend(), readid) - dimdispls.cbegin()) - 1;
+    return static_cast<int64_t>(dimid * dimsize + (readid - dimdispls[dimid]));
+}
+
+int64_t DistributedFastaData::getreadid(int64_t matrixid) const
+{
+    size_t dimid = matrixid / dimsize;
+    size_t offset = matrixid % dimsize;
+
+    return offset < dimdispls[dimid+1] - dimdispls[dimid]? static_cast<int64_t>(dimdispls[dimid] + offset) : -1;
 }
 
 using FastaDataRequest = typename DistributedFastaData::FastaDataRequest;
@@ -51,8 +252,10 @@ void DistributedFastaData::getgridrequests(std::vector<FastaDataRequest>& myrequ
 
     assert(readdispls[nprocs] == totreads);
 
-    /* assert that we are requesting more than zero reads, and that the range of reads exists within the FASTA */
-    assert(count >= 1 && 0 <= globalstartid && globalstartid + count <= totreads);
+    /* assert that the range of reads exists within the FASTA */
+    assert(0 <= globalstartid && globalstartid + count <= totreads);
+
+    if (count == 0) return;
 
     int owner = index.getreadowner(globalstartid);
     assert(readdispls[owner] <= globalstartid);
@@ -83,14 +286,60 @@ void DistributedFastaData::getgridrequests(std::vector<FastaDataRequest>& myrequ
          /* One past the last readid we are requesting from owner. */
         size_t reqend = std::min(nextstartid, globalstartid + count);
 
-         /* If the owner and requester are the same, adjust the rcflag. */
-        //unsigned short rcflag = owner != requester? rc : rc + 2;
-        myrequests.emplace_back(owner++, requester, reqstart, reqend - reqstart, rc);
+         /* Processors can own zero reads, in which case there is nothing to request. */
+        if (reqend > reqstart) myrequests.emplace_back(owner, requester, reqstart, reqend - reqstart, rc);
+        owner++;
+    }
+}
+
+void DistributedFastaData::getgridsends(std::vector<FastaDataRequest>& mysends, unsigned short rc) const
+{
+    std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
+    int nprocs = commgrid->GetSize();
+    int myrank = commgrid->GetRank();
+    int procdim = commgrid->GetGridRows();
+
+    size_t mystartid = index.getmyreaddispl();
+    size_t myendid = mystartid + index.getmyreadcount();
+
+    /*
+     * Every processor knows the read range of every grid row and column, and
+     * the read range owned by every processor, so instead of collecting everyone's
+     * requests I can work out which of my reads each processor will request from me.
+     * Processor @requester sits in grid row requester / procdim and grid column
+     * requester % procdim, and requests the reads of its row (rc=0) or column (rc=1)
+     * in exactly the pieces computed by getgridrequests(), unless it doesn't request
+     * that grid dimension at all (see requestsdim()).
+     */
+    for (int requester = 0; requester < nprocs; ++requester)
+    {
+        int dimid = rc == 0? requester / procdim : requester % procdim;
+        size_t startid, numreads;
+
+        /*
+         * I serve my own requests out of my own reads.
+         */
+        if (requester == myrank || !requestsdim(requester, rc))
+            continue;
+
+        getdimrange(dimid, startid, numreads);
+
+        size_t reqstart = std::max(startid, mystartid);
+        size_t reqend = std::min(startid + numreads, myendid);
+
+        if (reqend > reqstart) mysends.emplace_back(myrank, requester, reqstart, reqend - reqstart, rc);
     }
 }
 
 void DistributedFastaData::collect_sequences(const DnaBuffer& mydna)
 {
+    /*
+     * The read lengths we send must stay alive until wait().
+     */
+    myreadlens.resize(mydna.size());
+    for (size_t i = 0; i < mydna.size(); ++i) myreadlens[i] = mydna.getreadlen(i);
+    mydnaptr = &mydna;
+
     collect_dim_sequences(mydna, rowinfo);
     collect_dim_sequences(mydna, colinfo);
 }
@@ -101,127 +350,284 @@ void DistributedFastaData::collect_dim_sequences(const DnaBuffer& mydna, DimExch
 
     unsigned short rc = &diminfo == &rowinfo? 0 : 1;
     std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
-    int nprocs = commgrid->GetSize();
     int myrank = commgrid->GetRank();
     MPI_Comm comm = commgrid->GetWorld();
-    Logger logger(commgrid);
 
-    std::vector<FastaDataRequest> myreqs, mysends, allreqs;
+    std::vector<FastaDataRequest> mysends;
 
-    getgridrequests(myreqs, diminfo.startid, diminfo.numreads, rc);
+    /*
+     * On the diagonal my grid row and column hold the same reads, so I only
+     * request my row reads and the column buffer aliases them. With the shared
+     * store only one processor of each group makes requests. I still have to
+     * serve the requests of the other processors, though.
+     */
+    diminfo.myreqs.clear();
+    if (requestsdim(myrank, rc)) getgridrequests(diminfo.myreqs, diminfo.startid, diminfo.numreads, rc);
+    getgridsends(mysends, rc);
 
-    std::vector<MPI_Count_type> reqcounts(nprocs); /* Allgatherv receive counts */
-    std::vector<MPI_Displ_type> reqdispls(nprocs); /* Allgatherv receive displacements */
+    size_t mynumreqs = diminfo.myreqs.size();
+    size_t mynumsends = mysends.size();
 
-    size_t totnumreqs, mynumsends;
-    size_t mynumreqs = myreqs.size();
+    assert(mynumreqs <= std::numeric_limits<int>::max());
+    assert(2*mynumsends <= std::numeric_limits<int>::max());
 
     /*
-     * Globally collect the number of requests each processor wants to make.
+     * Nothing below blocks. The number of reads in each request is known up front,
+     * so the receives for the read lengths are posted right away. The size of the
+     * encoded sequences is only known once the read lengths have arrived, so their
+     * receives are posted by progress() (or at the latest by wait()). The sends of
+     * both are posted right away. The shared memory window is allocated collectively
+     * by its group, so with the shared store the receives are only posted by wait().
      */
-    reqcounts[myrank] = static_cast<MPI_Count_type>(mynumreqs);
-    MPI_ALLGATHER(MPI_IN_PLACE, 1, MPI_COUNT_TYPE, reqcounts.data(), 1, MPI_COUNT_TYPE, comm);
+    diminfo.reqnumreads = diminfo.numreads;
+    diminfo.reqreadlens.resize(diminfo.reqnumreads);
+    diminfo.lenrecvreqs.resize(mynumreqs);
+    diminfo.recvreqs.clear();
+    diminfo.bufposted = false;
 
-    /*
-     * Compute allgatherv displacements.
-     */
-    std::exclusive_scan(reqcounts.begin(), reqcounts.end(), reqdispls.begin(), static_cast<MPI_Displ_type>(0));
-    totnumreqs = reqdispls.back() + reqcounts.back();
-    allreqs.resize(totnumreqs);
+    for (size_t i = 0; i < mynumreqs; ++i)
+    {
+        const auto& req = diminfo.myreqs[i];
+        uint32_t *readlens = diminfo.reqreadlens.data() + (req.offset - diminfo.startid);
 
-    /*
-     * Create MPI_Datatype for FastaDataRequest (needed for allgatherv).
-     */
-    MPI_Datatype reqtype;
-    int blklens[5] = {1,1,1,1,1};
-    MPI_Aint displs[5] = {offsetof(FastaDataRequest, owner), offsetof(FastaDataRequest, requester), offsetof(FastaDataRequest, offset), offsetof(FastaDataRequest, count), offsetof(FastaDataRequest, rc)};
-    MPI_Datatype types[5] = {MPI_INT, MPI_INT, MPI_SIZE_T, MPI_SIZE_T, MPI_UNSIGNED_SHORT};
-    MPI_Type_create_struct(5, blklens, displs, types, &reqtype);
-    MPI_Type_commit(&reqtype);
+        /*
+         * Reads I own myself are not sent to myself. They are served
+         * straight out of @mydna when the buffers are assembled.
+         */
+        if (req.owner == myrank)
+        {
+            std::copy_n(myreadlens.begin() + (req.offset - index.getmyreaddispl()), req.count, readlens);
+            diminfo.lenrecvreqs[i] = MPI_REQUEST_NULL;
+        }
+        else MPI_IRECV(readlens, static_cast<MPI_Count_type>(req.count), MPI_UINT32_T, req.owner, 200+rc, comm, &diminfo.lenrecvreqs[i]);
+    }
+
+    diminfo.sendreqs.resize(2*mynumsends);
+
+    for (size_t i = 0; i < mynumsends; ++i)
+    {
+        size_t localoffset = mysends[i].offset - index.getmyreaddispl();
+        size_t sendbufsize = mydna.getrangebufsize(localoffset, mysends[i].count);
+        assert(localoffset + mysends[i].count <= index.getmyreadcount());
+
+        MPI_ISEND(myreadlens.data() + localoffset, static_cast<MPI_Count_type>(mysends[i].count), MPI_UINT32_T, mysends[i].requester, 200+rc, comm, &diminfo.sendreqs[2*i]);
+        MPI_ISEND(mydna.getbufoffset(localoffset), static_cast<MPI_Count_type>(sendbufsize), MPI_UINT8_T, mysends[i].requester, 300+rc, comm, &diminfo.sendreqs[2*i+1]);
+    }
+}
+
+void DistributedFastaData::post_dim_buffer_recvs(DimExchangeInfo& diminfo)
+{
+    unsigned short rc = &diminfo == &rowinfo? 0 : 1;
+    int myrank = index.getcommgrid()->GetRank();
+    MPI_Comm comm = index.getcommgrid()->GetWorld();
+    size_t mynumreqs = diminfo.myreqs.size();
 
     /*
-     * Globally collect all requests that are being made into @allreqs;
+     * Only the reads owned by other processors take up space in @reqbuf.
      */
-    MPI_ALLGATHERV(myreqs.data(), reqcounts[myrank], reqtype, allreqs.data(), reqcounts.data(), reqdispls.data(), reqtype, comm);
-    MPI_Type_free(&reqtype);
+    std::vector<size_t> reqbufdispls(mynumreqs+1, 0);
 
-    std::copy_if(allreqs.begin(), allreqs.end(), std::back_inserter(mysends), [&](const auto& req) { return req.owner == myrank; });
-    mynumsends = mysends.size();
+    for (size_t i = 0; i < mynumreqs; ++i)
+    {
+        const uint32_t *readlens = diminfo.reqreadlens.data() + (diminfo.myreqs[i].offset - diminfo.startid);
+        size_t bytes = std::accumulate(readlens, readlens + diminfo.myreqs[i].count, static_cast<size_t>(0), [](size_t sum, uint32_t len) { return sum + DnaSeq::bytesneeded(len); });
 
-    std::vector<size_t> reqinfo(2*mynumreqs); /* even indices are number of reads, odd indices are buffer sizes */
-    diminfo.recvreqs.resize(2*mynumreqs);
+        if (diminfo.myreqs[i].owner == myrank) diminfo.localbytes += bytes;
+        else reqbufdispls[i+1] = bytes;
+
+        reqbufdispls[i+1] += reqbufdispls[i];
+    }
+
+    diminfo.reqbufsize = reqbufdispls.back();
+    diminfo.reqbuf.reset(new uint8_t[diminfo.reqbufsize]);
+    diminfo.recvreqs.resize(mynumreqs);
 
     for (size_t i = 0; i < mynumreqs; ++i)
     {
-        MPI_IRECV(reqinfo.data() + (2*i), 2, MPI_SIZE_T, myreqs[i].owner, 100+myreqs[i].rc, comm, diminfo.recvreqs.data() + i);
+        MPI_Count_type bufsize = reqbufdispls[i+1] - reqbufdispls[i];
+
+        if (diminfo.myreqs[i].owner == myrank) diminfo.recvreqs[i] = MPI_REQUEST_NULL;
+        else MPI_IRECV(diminfo.reqbuf.get() + reqbufdispls[i], bufsize, MPI_UINT8_T, diminfo.myreqs[i].owner, 300+rc, comm, &diminfo.recvreqs[i]);
     }
 
-    std::vector<size_t> sendlens(mynumsends), sendbufsizes(mynumsends);
-    std::vector<const uint8_t*> sendbufs(mynumsends);
+    diminfo.bufposted = true;
+}
+
+std::shared_ptr<DnaBuffer> DistributedFastaData::assemble_dim_buffer(DimExchangeInfo& diminfo)
+{
+    int myrank = index.getcommgrid()->GetRank();
+    size_t myreaddispl = index.getmyreaddispl();
+    size_t bufhead = 0;
 
-    for (size_t i = 0; i < mynumsends; ++i)
+    std::vector<uint64_t> readoffsets;
+    readoffsets.reserve(diminfo.reqnumreads);
+
+    uint8_t *buf = diminfo.reqbuf.release();
+
+    /*
+     * Requests cover the reads of my grid row (or column) in order. Received
+     * reads are laid out one after the other in @buf (segment 0), and my own
+     * reads point into @mydna (segment 1) without being copied.
+     */
+    for (const auto& req : diminfo.myreqs)
     {
-        assert(mysends[i].owner == myrank);
-        size_t offset = mysends[i].offset;
-        size_t localoffset = offset - index.getmyreaddispl();
-        sendlens[i] = mysends[i].count;
-        assert(index.getmyreaddispl() <= offset && offset + sendlens[i] <= index.getmyreaddispl() + index.getmyreadcount());
-        sendbufsizes[i] = mydna.getrangebufsize(localoffset, sendlens[i]);
-        sendbufs[i] = mydna.getbufoffset(localoffset);
-        size_t sendbuf[2] = {sendlens[i], sendbufsizes[i]};
-        MPI_SEND(sendbuf, 2, MPI_SIZE_T, mysends[i].requester, 100+mysends[i].rc, comm);
+        for (size_t id = req.offset; id < req.offset + req.count; ++id)
+        {
+            if (req.owner == myrank)
+            {
+                readoffsets.push_back(DnaBuffer::makeoffset(1, mydnaptr->getbufoffset(id - myreaddispl) - mydnaptr->getbufoffset(0)));
+            }
+            else
+            {
+                readoffsets.push_back(DnaBuffer::makeoffset(0, bufhead));
+                bufhead += DnaSeq::bytesneeded(diminfo.reqreadlens[id - diminfo.startid]);
+            }
+        }
     }
 
-    assert(2*mynumreqs <= std::numeric_limits<int>::max());
-    assert(2*mynumsends <= std::numeric_limits<int>::max());
+    assert(bufhead == diminfo.reqbufsize && readoffsets.size() == diminfo.reqnumreads);
+
+    std::vector<const uint8_t*> segments = {buf, mydnaptr->size() > 0? mydnaptr->getbufoffset(0) : nullptr};
+
+    return std::make_shared<DnaBuffer>(diminfo.reqbufsize, buf, std::move(segments), std::move(readoffsets), std::move(diminfo.reqreadlens));
+}
+
+void DistributedFastaData::post_dim_shared_recvs(DimExchangeInfo& diminfo)
+{
+    unsigned short rc = &diminfo == &rowinfo? 0 : 1;
+    int myrank = index.getcommgrid()->GetRank();
+    MPI_Comm comm = index.getcommgrid()->GetWorld();
+    size_t myreaddispl = index.getmyreaddispl();
+    size_t mynumreqs = diminfo.myreqs.size();
 
     /*
-     * Note that we don't use 2*mynum{sends,reqs} below for the count.
+     * The processor that makes the requests allocates the whole window: the read
+     * lengths of my grid row (or column) followed by its encoded reads, my own
+     * reads included, since the other processors of the group need them too.
+     * Everyone else in the group attaches to it with an empty segment.
      */
-    MPI_Waitall(static_cast<int>(mynumreqs), diminfo.recvreqs.data(), MPI_STATUSES_IGNORE);
-
-    std::vector<size_t> reqreadlendispls(mynumreqs+1);
-    std::vector<size_t> reqbufdispls(mynumreqs+1);
-    reqreadlendispls.front() = reqbufdispls.front() = 0;
+    size_t numreads = mynumreqs > 0? diminfo.reqnumreads : 0;
+    std::vector<size_t> reqbufdispls(mynumreqs+1, 0);
 
     for (size_t i = 0; i < mynumreqs; ++i)
     {
-        reqreadlendispls[i+1] = reqreadlendispls[i] + reqinfo[2*i];
-        reqbufdispls[i+1] = reqbufdispls[i] + reqinfo[2*i+1];
+        const uint32_t *readlens = diminfo.reqreadlens.data() + (diminfo.myreqs[i].offset - diminfo.startid);
+        size_t bytes = std::accumulate(readlens, readlens + diminfo.myreqs[i].count, static_cast<size_t>(0), [](size_t sum, uint32_t len) { return sum + DnaSeq::bytesneeded(len); });
+
+        if (diminfo.myreqs[i].owner == myrank) diminfo.localbytes += bytes;
+        reqbufdispls[i+1] = reqbufdispls[i] + bytes;
     }
 
-    diminfo.reqnumreads = reqreadlendispls.back();
-    diminfo.reqbufsize = reqbufdispls.back();
-    diminfo.reqreadlens.reset(new size_t[diminfo.reqnumreads]);
-    diminfo.reqbuf.reset(new uint8_t[diminfo.reqbufsize]);
+    diminfo.reqbufsize = reqbufdispls.back() - diminfo.localbytes;
+
+    uint8_t *segment;
+    MPI_Aint segsize = numreads * sizeof(uint32_t) + reqbufdispls.back();
+    MPI_Win_allocate_shared(segsize, 1, MPI_INFO_NULL, diminfo.shmcomm, &segment, &diminfo.shmwin);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, diminfo.shmwin);
+
+    std::copy_n(diminfo.reqreadlens.data(), numreads, reinterpret_cast<uint32_t*>(segment));
+    std::vector<uint32_t>().swap(diminfo.reqreadlens);
+
+    uint8_t *buf = segment + numreads * sizeof(uint32_t);
+
+    diminfo.recvreqs.resize(mynumreqs);
 
     for (size_t i = 0; i < mynumreqs; ++i)
     {
-        MPI_Count_type count = reqreadlendispls[i+1] - reqreadlendispls[i];
+        const auto& req = diminfo.myreqs[i];
         MPI_Count_type bufsize = reqbufdispls[i+1] - reqbufdispls[i];
-        MPI_IRECV(diminfo.reqreadlens.get() + reqreadlendispls[i], count, MPI_SIZE_T, myreqs[i].owner, 200+myreqs[i].rc, comm, diminfo.recvreqs.data() + i);
-        MPI_IRECV(diminfo.reqbuf.get() + reqbufdispls[i], bufsize, MPI_UINT8_T, myreqs[i].owner, 300+myreqs[i].rc, comm, diminfo.recvreqs.data() + mynumreqs + i);
+
+        if (req.owner == myrank)
+        {
+            std::copy_n(mydnaptr->getbufoffset(req.offset - myreaddispl), bufsize, buf + reqbufdispls[i]);
+            diminfo.recvreqs[i] = MPI_REQUEST_NULL;
+        }
+        else MPI_IRECV(buf + reqbufdispls[i], bufsize, MPI_UINT8_T, req.owner, 300+rc, comm, &diminfo.recvreqs[i]);
     }
 
-    std::vector<size_t> myreadlens = index.getmyreadlens();
+    diminfo.bufposted = true;
+}
 
-    for (size_t i = 0; i < mynumsends; ++i)
+std::shared_ptr<DnaBuffer> DistributedFastaData::assemble_dim_shared_buffer(DimExchangeInfo& diminfo)
+{
+    /*
+     * Make the writes of the receiving processor visible to the rest of the group.
+     */
+    MPI_Win_sync(diminfo.shmwin);
+    MPI_Barrier(diminfo.shmcomm);
+    MPI_Win_sync(diminfo.shmwin);
+
+    uint8_t *segment;
+    MPI_Aint segsize;
+    int dispunit;
+    MPI_Win_shared_query(diminfo.shmwin, 0, &segsize, &dispunit, &segment);
+
+    const uint32_t *readlens = reinterpret_cast<const uint32_t*>(segment);
+    size_t bufhead = 0;
+
+    std::vector<uint64_t> readoffsets;
+    readoffsets.reserve(diminfo.numreads);
+
+    for (size_t i = 0; i < diminfo.numreads; ++i)
     {
-        size_t localoffset = mysends[i].offset - index.getmyreaddispl();
-        const size_t *sendreadlens = myreadlens.data() + localoffset;
-        const uint8_t *sendbuf = mydna.getbufoffset(localoffset);
-        MPI_SEND(sendreadlens, static_cast<MPI_Count_type>(sendlens[i]), MPI_SIZE_T, mysends[i].requester, 200+mysends[i].rc, comm);
-        MPI_SEND(sendbuf, static_cast<MPI_Count_type>(sendbufsizes[i]), MPI_UINT8_T, mysends[i].requester, 300+mysends[i].rc, comm);
+        readoffsets.push_back(bufhead);
+        bufhead += DnaSeq::bytesneeded(readlens[i]);
+    }
+
+    assert(diminfo.numreads == 0 || static_cast<size_t>(segsize) == diminfo.numreads * sizeof(uint32_t) + bufhead);
+
+    /*
+     * The window stays owned by this object, so the buffer owns no memory.
+     */
+    std::vector<const uint8_t*> segments = {segment + diminfo.numreads * sizeof(uint32_t)};
+    return std::make_shared<DnaBuffer>(0, nullptr, std::move(segments), std::move(readoffsets), std::vector<uint32_t>(readlens, readlens + diminfo.numreads));
+}
+
+void DistributedFastaData::progress()
+{
+    for (DimExchangeInfo *diminfo : {&rowinfo, &colinfo})
+    {
+        if (diminfo->bufposted || diminfo->shmcomm != MPI_COMM_NULL)
+            continue;
+
+        int arrived;
+        MPI_Testall(static_cast<int>(diminfo->lenrecvreqs.size()), diminfo->lenrecvreqs.data(), &arrived, MPI_STATUSES_IGNORE);
+
+        if (arrived) post_dim_buffer_recvs(*diminfo);
     }
 }
 
 void DistributedFastaData::wait()
 {
+    for (DimExchangeInfo *diminfo : {&rowinfo, &colinfo})
+    {
+        if (!diminfo->bufposted)
+        {
+            MPI_Waitall(static_cast<int>(diminfo->lenrecvreqs.size()), diminfo->lenrecvreqs.data(), MPI_STATUSES_IGNORE);
+
+            if (diminfo->shmcomm != MPI_COMM_NULL) post_dim_shared_recvs(*diminfo);
+            else post_dim_buffer_recvs(*diminfo);
+        }
+    }
+
     MPI_Waitall(static_cast<int>(rowinfo.recvreqs.size()), rowinfo.recvreqs.data(), MPI_STATUSES_IGNORE);
     MPI_Waitall(static_cast<int>(colinfo.recvreqs.size()), colinfo.recvreqs.data(), MPI_STATUSES_IGNORE);
+    MPI_Waitall(static_cast<int>(rowinfo.sendreqs.size()), rowinfo.sendreqs.data(), MPI_STATUSES_IGNORE);
+    MPI_Waitall(static_cast<int>(colinfo.sendreqs.size()), colinfo.sendreqs.data(), MPI_STATUSES_IGNORE);
+
+    rowbuf = rowinfo.shmcomm != MPI_COMM_NULL? assemble_dim_shared_buffer(rowinfo) : assemble_dim_buffer(rowinfo);
+
+    if (colinfo.shmcomm != MPI_COMM_NULL) colbuf = assemble_dim_shared_buffer(colinfo);
+    else colbuf = isdiag? rowbuf : assemble_dim_buffer(colinfo);
 
-    rowbuf.reset(new DnaBuffer(rowinfo.reqbufsize, rowinfo.reqnumreads, rowinfo.reqbuf.release(), rowinfo.reqreadlens.get()));
-    colbuf.reset(new DnaBuffer(colinfo.reqbufsize, colinfo.reqnumreads, colinfo.reqbuf.release(), colinfo.reqreadlens.get()));
+    myreadlens.clear();
+    myreadlens.shrink_to_fit();
+
+    #if LOG_LEVEL >= 2
+    Logger logger(index.getcommgrid());
+    logger() << "received " << rowinfo.reqbufsize + colinfo.reqbufsize << " bytes, served " << rowinfo.localbytes + colinfo.localbytes << " bytes from my own reads" << (isdiag && colbuf == rowbuf? ", column buffer aliases row buffer" : "");
+    logger.Flush("2D processor grid sequence exchange:");
+    #endif
 }
 
 std::string getgridfname(char const *fname_prefix, int rank, bool rc)
@@ -1,18 +1,40 @@
 #include "DnaBuffer.hpp"
 #include "Logger.hpp"
 #include <cassert>
+#include <limits>
 
-DnaBuffer::DnaBuffer(size_t bufsize, size_t numreads, uint8_t *buf, const size_t *readlens) : bufhead(0), bufsize(bufsize), buf(buf)
+DnaBuffer::DnaBuffer(size_t bufsize, size_t numreads, uint8_t *buf, const size_t *readlens, std::vector<uint32_t> nrunoffsets, std::vector<NRun> nruns)
+    : bufhead(0), bufsize(bufsize), buf(buf), segments(1, buf), nrunoffsets(std::move(nrunoffsets)), nruns(std::move(nruns))
 {
-    sequences.reserve(numreads);
+    if (this->nrunoffsets.empty())
+        this->nrunoffsets.assign(numreads+1, 0);
+
+    assert(this->nrunoffsets.size() == numreads+1 && this->nrunoffsets.back() == this->nruns.size());
+
+    readoffsets.reserve(numreads);
+    this->readlens.reserve(numreads);
 
     for (size_t i = 0; i < numreads; ++i)
     {
-        sequences.emplace_back(readlens[i], buf + bufhead);
-        bufhead += sequences.back().numbytes();
+        assert(readlens[i] <= std::numeric_limits<uint32_t>::max());
+        readoffsets.push_back(bufhead);
+        this->readlens.push_back(static_cast<uint32_t>(readlens[i]));
+        bufhead += DnaSeq::bytesneeded(readlens[i]);
     }
 }
 
+DnaBuffer::DnaBuffer(size_t bufsize, uint8_t *buf, std::vector<const uint8_t*> segments, std::vector<uint64_t> readoffsets, std::vector<uint32_t> readlens)
+    : bufhead(bufsize), bufsize(bufsize), buf(buf), segments(std::move(segments)), readoffsets(std::move(readoffsets)), readlens(std::move(readlens))
+{
+    assert(this->readoffsets.size() == this->readlens.size());
+}
+
+size_t DnaBuffer::getmetadatasize() const
+{
+    return segments.size() * sizeof(segments[0]) + readoffsets.size() * sizeof(readoffsets[0]) + readlens.size() * sizeof(readlens[0]) +
+           nrunoffsets.size() * sizeof(nrunoffsets[0]) + nruns.size() * sizeof(nruns[0]);
+}
+
 size_t DnaBuffer::computebufsize(const std::vector<size_t>& seqlens)
 {
     auto bytecounter = [](size_t sum, size_t len) { return sum + DnaSeq::bytesneeded(len); };
@@ -22,18 +44,36 @@ size_t DnaBuffer::computebufsize(const std::vector<size_t>& seqlens)
 void DnaBuffer::push_back(char const *s, size_t len)
 {
     size_t nbytes = DnaSeq::bytesneeded(len);
-    assert(bufhead + nbytes <= bufsize);
-    sequences.emplace_back(s, len, buf + bufhead);
-    assert(nbytes == sequences.back().numbytes());
+    assert(bufhead + nbytes <= bufsize && len <= std::numeric_limits<uint32_t>::max());
+    DnaSeq(s, len, buf + bufhead); /* 2-bit encodes @s into @buf */
+    readoffsets.push_back(bufhead);
+    readlens.push_back(static_cast<uint32_t>(len));
     bufhead += nbytes;
+
+    /*
+     * Ns are encoded as As, so remember where they were. Otherwise a run
+     * of Ns would look like a poly-A stretch full of repetitive k-mers.
+     */
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (DnaSeq::isambiguous(s[i]))
+        {
+            size_t begin = i;
+            while (i < len && DnaSeq::isambiguous(s[i])) ++i;
+            nruns.push_back({static_cast<uint32_t>(begin), static_cast<uint32_t>(i)});
+        }
+    }
+
+    assert(nruns.size() <= std::numeric_limits<uint32_t>::max());
+    nrunoffsets.push_back(static_cast<uint32_t>(nruns.size()));
 }
 
 size_t DnaBuffer::getrangebufsize(size_t start, size_t count) const
 {
-    if (start + count == 0) return 0;
+    if (count == 0) return 0;
     size_t end = start+count-1;
-    const uint8_t* startmem = sequences[start].data();
-    const uint8_t* endmem = sequences[end].data() + sequences[end].numbytes();
+    const uint8_t* startmem = getbufoffset(start);
+    const uint8_t* endmem = getbufoffset(end) + DnaSeq::bytesneeded(readlens[end]);
     return (endmem-startmem);
 }
 
@@ -43,7 +83,7 @@ std::string DnaBuffer::getasciifilecontents() const
 
     for (size_t i = 0; i < size(); ++i)
     {
-        ss << sequences[i].ascii() << "\n";
+        ss << (*this)[i].ascii() << "\n";
     }
 
     return ss.str();
@@ -4,10 +4,15 @@
 #include <vector>
 #include <cmath>
 
-void DnaSeq::compress(char const *s)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DNASEQ_X86_KERNELS
+#endif
+
+void DnaSeq::encodescalar(char const *s, size_t len, uint8_t *mem)
 {
-    const size_t nbytes = numbytes();
-    const int remain = remainder();
+    const size_t nbytes = bytesneeded(len);
+    const int remain = 4*nbytes - len;
     char const *p = s;
     size_t b = 0;
 
@@ -18,39 +23,237 @@ void DnaSeq::compress(char const *s)
 
         for (int i = 0; i < left; ++i)
         {
-            uint8_t code = DnaSeq::getcharcode(p[i]);
+            uint8_t code = DnaSeq::getcharcode(p[i]) & 3; /* X -> A */
             uint8_t shift = code << (6 - (2*i));
             byte |= shift;
         }
 
-        memory[b++] = byte;
+        mem[b++] = byte;
         p += 4;
     }
 }
 
-std::string DnaSeq::ascii() const
+void DnaSeq::decodescalar(uint8_t const *mem, size_t len, char *s)
 {
-    size_t len = size();
-    uint8_t const *p = memory;
-    std::string s(len, '\0');
+    size_t nfull = len / 4;
 
-    for (size_t i = 0; i < len; ++i)
+    for (size_t b = 0; b < nfull; ++b)
     {
-        int code = (*p >> (6 - (2*(i%4)))) & 3;
-        s[i] = DnaSeq::getcodechar(code);
+        uint8_t byte = mem[b];
+        s[4*b+0] = chartab[(byte >> 6) & 3];
+        s[4*b+1] = chartab[(byte >> 4) & 3];
+        s[4*b+2] = chartab[(byte >> 2) & 3];
+        s[4*b+3] = chartab[(byte >> 0) & 3];
+    }
+
+    for (size_t i = 4*nfull; i < len; ++i)
+        s[i] = chartab[(mem[i/4] >> (6 - (2*(i%4)))) & 3];
+}
+
+#ifdef DNASEQ_X86_KERNELS
+
+/*
+ * The low nibbles of 'A', 'C', 'G' and 'T' (and of their lower case versions) are
+ * 1, 3, 7 and 4, which are all distinct. A byte shuffle with the low nibble of each
+ * character as the index therefore maps 16 or 32 characters to their 2-bit codes at
+ * once: A -> 0, C -> 1, G -> 2, T -> 3. Other characters share these low nibbles
+ * ('S' is 0x53, like 'C'), so a second shuffle gives the lower case nucleotide
+ * expected for each nibble, and characters that don't match it (once lower-cased
+ * by setting 0x20) get code 0 like N and everything else in the scalar kernel.
+ */
+#define DNASEQ_ENCODE_LUT 0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0
+#define DNASEQ_ENCODE_CHECK 0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0
 
-        if ((i+1) % 4 == 0)
-            p++;
+/*
+ * Four consecutive codes c0,c1,c2,c3 are packed into the byte (c0<<6)|(c1<<4)|(c2<<2)|c3
+ * with two multiply-adds: maddubs with weights (4,1) gives (c0<<2)|c1 and (c2<<2)|c3
+ * as 16-bit words, and madd with weights (16,1) combines them into a 32-bit word.
+ *
+ * Decoding goes the other way around: each byte is replicated four times, and the
+ * i-th copy is masked so that only the bits of its i-th code remain. The masked
+ * values c<<6, c<<4, c<<2 and c turn into distinct shuffle indices 4c, c, 4c and c
+ * after or-ing the high nibble (shifted down) with the low nibble.
+ */
+#define DNASEQ_DECODE_LUT 'A', 'C', 'G', 'T', 'C', 'A', 'A', 'A', 'G', 'A', 'A', 'A', 'T', 'A', 'A', 'A'
+#define DNASEQ_DECODE_MASK 0xC0, 0x30, 0x0C, 0x03, 0xC0, 0x30, 0x0C, 0x03, 0xC0, 0x30, 0x0C, 0x03, 0xC0, 0x30, 0x0C, 0x03
+
+__attribute__((target("sse4.1")))
+static inline __m128i pack16(char const *p, __m128i lut, __m128i check)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i w1 = _mm_set1_epi16(0x0104); /* bytes (4,1) */
+    const __m128i w2 = _mm_set1_epi32(0x00010010); /* words (16,1) */
+
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i idx = _mm_and_si128(c, nibble);
+    __m128i isnuc = _mm_cmpeq_epi8(_mm_or_si128(c, lower), _mm_shuffle_epi8(check, idx));
+    c = _mm_and_si128(_mm_shuffle_epi8(lut, idx), isnuc);
+    return _mm_madd_epi16(_mm_maddubs_epi16(c, w1), w2);
+}
+
+__attribute__((target("sse4.1")))
+static size_t encodesse(char const *s, size_t len, uint8_t *mem)
+{
+    const __m128i lut = _mm_setr_epi8(DNASEQ_ENCODE_LUT);
+    const __m128i check = _mm_setr_epi8(DNASEQ_ENCODE_CHECK);
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64)
+    {
+        __m128i a = pack16(s + i, lut, check);
+        __m128i b = pack16(s + i + 16, lut, check);
+        __m128i c = pack16(s + i + 32, lut, check);
+        __m128i d = pack16(s + i + 48, lut, check);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mem + i/4), packed);
     }
-    return s;
+
+    return i;
 }
 
-int DnaSeq::operator[](size_t i) const
+__attribute__((target("avx2")))
+static inline __m256i pack32(char const *p, __m256i lut, __m256i check)
 {
-    uint8_t byte = memory[i/4];
-    int shift = 6 - (2 * (i%4));
-    int code = (byte >> shift)&3;
-    return code;
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i w1 = _mm256_set1_epi16(0x0104);
+    const __m256i w2 = _mm256_set1_epi32(0x00010010);
+
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i idx = _mm256_and_si256(c, nibble);
+    __m256i isnuc = _mm256_cmpeq_epi8(_mm256_or_si256(c, lower), _mm256_shuffle_epi8(check, idx));
+    c = _mm256_and_si256(_mm256_shuffle_epi8(lut, idx), isnuc);
+    return _mm256_madd_epi16(_mm256_maddubs_epi16(c, w1), w2);
+}
+
+__attribute__((target("avx2")))
+static size_t encodeavx2(char const *s, size_t len, uint8_t *mem)
+{
+    const __m256i lut = _mm256_setr_epi8(DNASEQ_ENCODE_LUT, DNASEQ_ENCODE_LUT);
+    const __m256i check = _mm256_setr_epi8(DNASEQ_ENCODE_CHECK, DNASEQ_ENCODE_CHECK);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); /* undo the in-lane interleaving of the packs */
+    size_t i;
+
+    for (i = 0; i + 128 <= len; i += 128)
+    {
+        __m256i a = pack32(s + i, lut, check);
+        __m256i b = pack32(s + i + 32, lut, check);
+        __m256i c = pack32(s + i + 64, lut, check);
+        __m256i d = pack32(s + i + 96, lut, check);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(mem + i/4), _mm256_permutevar8x32_epi32(packed, order));
+    }
+
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t decodesse(uint8_t const *mem, size_t len, char *s)
+{
+    const __m128i lut = _mm_setr_epi8(DNASEQ_DECODE_LUT);
+    const __m128i mask = _mm_setr_epi8(DNASEQ_DECODE_MASK);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16)
+    {
+        int32_t word;
+        std::memcpy(&word, mem + i/4, 4);
+        __m128i t = _mm_and_si128(_mm_shuffle_epi8(_mm_cvtsi32_si128(word), spread), mask);
+        __m128i idx = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(t, 4), nibble), _mm_and_si128(t, nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), _mm_shuffle_epi8(lut, idx));
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decodeavx2(uint8_t const *mem, size_t len, char *s)
+{
+    const __m256i lut = _mm256_setr_epi8(DNASEQ_DECODE_LUT, DNASEQ_DECODE_LUT);
+    const __m256i mask = _mm256_setr_epi8(DNASEQ_DECODE_MASK, DNASEQ_DECODE_MASK);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                            4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32)
+    {
+        __m256i bytes = _mm256_broadcastsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mem + i/4)));
+        __m256i t = _mm256_and_si256(_mm256_shuffle_epi8(bytes, spread), mask);
+        __m256i idx = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(t, 4), nibble), _mm256_and_si256(t, nibble));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(s + i), _mm256_shuffle_epi8(lut, idx));
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * The kernels are picked once at startup, based on what the CPU we are
+ * running on supports. The vector kernels process the sequence in blocks
+ * and return how many nucleotides they handled (always a multiple of 4);
+ * the rest is finished by the scalar kernels.
+ */
+typedef size_t (*encodekernel_t)(char const*, size_t, uint8_t*);
+typedef size_t (*decodekernel_t)(uint8_t const*, size_t, char*);
+
+static size_t encodenone(char const *s, size_t len, uint8_t *mem) { return 0; }
+static size_t decodenone(uint8_t const *mem, size_t len, char *s) { return 0; }
+
+static int getsimdlevel()
+{
+    #ifdef DNASEQ_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return 2;
+    if (__builtin_cpu_supports("sse4.1")) return 1;
+    #endif
+    return 0;
+}
+
+static const int simdlevel = getsimdlevel();
+
+#ifdef DNASEQ_X86_KERNELS
+static const encodekernel_t encodekernel = simdlevel == 2? encodeavx2 : simdlevel == 1? encodesse : encodenone;
+static const decodekernel_t decodekernel = simdlevel == 2? decodeavx2 : simdlevel == 1? decodesse : decodenone;
+#else
+static const encodekernel_t encodekernel = encodenone;
+static const decodekernel_t decodekernel = decodenone;
+#endif
+
+char const* DnaSeq::simdname()
+{
+    static char const *names[3] = {"scalar", "sse4.1", "avx2"};
+    return names[simdlevel];
+}
+
+void DnaSeq::encode(char const *s, size_t len, uint8_t *mem)
+{
+    size_t done = encodekernel(s, len, mem);
+    encodescalar(s + done, len - done, mem + done/4);
+}
+
+void DnaSeq::decode(uint8_t const *mem, size_t len, char *s)
+{
+    size_t done = decodekernel(mem, len, s);
+    decodescalar(mem + done/4, len - done, s + done);
+}
+
+void DnaSeq::compress(char const *s)
+{
+    encode(s, len, memory);
+}
+
+std::string DnaSeq::ascii() const
+{
+    std::string s(size(), '\0');
+    decode(memory, size(), &s[0]);
+    return s;
 }
 
 bool DnaSeq::operator==(const DnaSeq& rhs)
@@ -58,8 +261,8 @@ bool DnaSeq::operator==(const DnaSeq& rhs)
     if (size() != rhs.size())
         return false;
 
-    for (size_t i = 0; i < rhs.size(); ++i)
-        if ((*this)[i] != rhs[i])
+    for (size_t i = 0; i < size(); i += 32)
+        if (getword(i) != rhs.getword(i))
             return false;
 
     return true;
@@ -68,11 +271,20 @@ bool DnaSeq::operator==(const DnaSeq& rhs)
 bool DnaSeq::operator<(const DnaSeq& rhs)
 {
     size_t len = std::min(size(), rhs.size());
-    size_t i;
 
-    for (i = 0; (*this)[i] == rhs[i] && i < len; ++i);
+    /*
+     * Since nucleotide i sits in the most significant bits of getword(i),
+     * comparing the words as integers compares them lexicographically.
+     */
+    for (size_t i = 0; i < len; i += 32)
+    {
+        uint64_t mask = len - i < 32? ~0ULL << (2 * (32 - (len - i))) : ~0ULL;
+        uint64_t mine = getword(i) & mask;
+        uint64_t theirs = rhs.getword(i) & mask;
 
-    if (i == len) return false;
+        if (mine != theirs)
+            return mine < theirs;
+    }
 
-    return ((*this)[i] < rhs[i]);
+    return false;
 }
@@ -0,0 +1,119 @@
+#include "ElbaSeq.hpp"
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <cassert>
+
+constexpr char ElbaSeqHeader::elbaseq_magic[8];
+
+bool iselbaseq(const std::string& fname)
+{
+    char magic[8];
+    std::ifstream filestream(fname, std::ios::binary);
+
+    if (!filestream.read(magic, 8))
+        return false;
+
+    return std::memcmp(magic, ElbaSeqHeader::elbaseq_magic, 8) == 0;
+}
+
+void writeelbaseq(const std::string& fname, const FastaIndex& index, const DnaBuffer& buffer, const std::vector<std::string>& mynames)
+{
+    auto commgrid = index.getcommgrid();
+    int myrank = commgrid->GetRank();
+    int nprocs = commgrid->GetSize();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    uint64_t mynumreads = buffer.size();
+    assert(mynames.size() == mynumreads);
+
+    /*
+     * Every section of the file is a concatenation of the parts contributed by
+     * each processor in rank order, so a prefix sum over my read count, buffer
+     * size, name characters, and N runs tells me where my parts go.
+     */
+    uint64_t mycounts[4], mydispls[4] = {0, 0, 0, 0}, totals[4];
+
+    mycounts[0] = mynumreads;
+    mycounts[1] = buffer.getrangebufsize(0, mynumreads);
+    mycounts[2] = std::accumulate(mynames.begin(), mynames.end(), static_cast<uint64_t>(0), [](uint64_t sum, const std::string& s) { return sum + s.size(); });
+    mycounts[3] = buffer.getallnruns().size();
+
+    MPI_Exscan(mycounts, mydispls, 4, MPI_UINT64_T, MPI_SUM, comm);
+    if (myrank == 0) std::fill(mydispls, mydispls + 4, 0);
+
+    MPI_ALLREDUCE(mycounts, totals, 4, MPI_UINT64_T, MPI_SUM, comm);
+
+    ElbaSeqHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ElbaSeqHeader::elbaseq_magic, 8);
+    header.version = ElbaSeqHeader::elbaseq_version;
+    header.numreads = totals[0];
+    header.bufsize = totals[1];
+    header.namebytes = totals[2];
+    header.numnruns = totals[3];
+
+    /*
+     * Local parts of the read lengths and offset sections. The last processor
+     * also writes the closing entry of each offset section.
+     */
+    uint64_t mynumoffsets = mynumreads + (myrank == nprocs-1);
+    std::vector<uint64_t> readlens(mynumreads), bufoffsets(mynumoffsets), nameoffsets(mynumoffsets), nrunoffsets(mynumoffsets);
+    std::vector<uint64_t> nruns;
+    std::vector<char> namebuf;
+    namebuf.reserve(mycounts[2]);
+
+    uint64_t bufoffset = mydispls[1], nameoffset = mydispls[2];
+
+    for (uint64_t i = 0; i < mynumreads; ++i)
+    {
+        readlens[i] = buffer[i].size();
+        bufoffsets[i] = bufoffset;
+        nameoffsets[i] = nameoffset;
+        nrunoffsets[i] = mydispls[3] + buffer.getnrunoffsets()[i];
+        bufoffset += buffer[i].numbytes();
+        nameoffset += mynames[i].size();
+        namebuf.insert(namebuf.end(), mynames[i].begin(), mynames[i].end());
+    }
+
+    if (myrank == nprocs-1)
+    {
+        bufoffsets.back() = bufoffset;
+        nameoffsets.back() = nameoffset;
+        nrunoffsets.back() = mydispls[3] + mycounts[3];
+    }
+
+    nruns.reserve(2 * mycounts[3]);
+
+    for (const NRun& nrun : buffer.getallnruns())
+    {
+        nruns.push_back(nrun.begin);
+        nruns.push_back(nrun.end);
+    }
+
+    const uint8_t *mybuf = mynumreads > 0? buffer.getbufoffset(0) : nullptr;
+
+    MPI_File fh;
+    int err = MPI_File_open(comm, fname.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+
+    if (err != MPI_SUCCESS)
+    {
+        if (myrank == 0) std::cerr << "error: could not create " << fname << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_File_set_size(fh, 0);
+
+    if (myrank == 0)
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_FILE_WRITE_AT_ALL(fh, header.readlensoffset() + 8 * mydispls[0], readlens.data(), static_cast<MPI_Count_type>(mynumreads), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.bufoffsetsoffset() + 8 * mydispls[0], bufoffsets.data(), static_cast<MPI_Count_type>(mynumoffsets), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.nameoffsetsoffset() + 8 * mydispls[0], nameoffsets.data(), static_cast<MPI_Count_type>(mynumoffsets), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.namesoffset() + mydispls[2], namebuf.data(), static_cast<MPI_Count_type>(mycounts[2]), MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.nrunoffsetsoffset() + 8 * mydispls[0], nrunoffsets.data(), static_cast<MPI_Count_type>(mynumoffsets), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.nrunsoffset() + 16 * mydispls[3], nruns.data(), static_cast<MPI_Count_type>(nruns.size()), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_WRITE_AT_ALL(fh, header.bufferoffset() + mydispls[1], mybuf, static_cast<MPI_Count_type>(mycounts[1]), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&fh);
+}
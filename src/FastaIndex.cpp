@@ -1,5 +1,7 @@
 #include "FastaIndex.hpp"
 #include "Logger.hpp"
+#include "BgzfIndex.hpp"
+#include "ElbaSeq.hpp"
 #include <cstring>
 #include <iterator>
 #include <algorithm>
@@ -9,6 +11,7 @@
 #include <sstream>
 #include <iostream>
 #include <memory>
+#include <cctype>
 
 using Record = typename FastaIndex::Record;
 
@@ -44,6 +47,35 @@ int FastaIndex::getreadowner(size_t i) const
     return static_cast<int>(iditr - readdispls.cbegin());
 }
 
+void FastaIndex::ensure_nonempty_partition(std::vector<MPI_Count_type>& counts)
+{
+    /*
+     * The boundary of part p goes up to p plus the largest slack (boundary minus
+     * index) of the parts before it, and then down to leave a read for each
+     * part after it.
+     */
+    int nprocs = counts.size();
+    MPI_Count_type numreads = std::accumulate(counts.begin(), counts.end(), static_cast<MPI_Count_type>(0));
+
+    if (numreads < nprocs)
+        return;
+
+    std::vector<MPI_Count_type> displs(nprocs+1);
+    MPI_Count_type start = 0, slack = 0;
+
+    for (int p = 0; p < nprocs; ++p)
+    {
+        slack = std::max(slack, start - p);
+        displs[p] = p + std::min(numreads - nprocs, slack);
+        start += counts[p];
+    }
+
+    displs[nprocs] = numreads;
+
+    for (int p = 0; p < nprocs; ++p)
+        counts[p] = displs[p+1] - displs[p];
+}
+
 void FastaIndex::getpartition(std::vector<MPI_Count_type>& sendcounts)
 {
     int myrank = commgrid->GetRank();
@@ -51,59 +83,577 @@ void FastaIndex::getpartition(std::vector<MPI_Count_type>& sendcounts)
     assert(sendcounts.size() == nprocs);
 
     size_t totbases = std::accumulate(rootrecords.begin(), rootrecords.end(), static_cast<size_t>(0), [](size_t sum, const auto& record) { return sum + record.len; });
-    size_t numreads = rootrecords.size();
-    double avgbasesperproc = static_cast<double>(totbases) / nprocs;
+    size_t basesbefore = 0;
 
     /*
      * Coming up with the optimal partitioning of sequences weighted by their length
-     * is NP-hard, and I can't imagine that it is NP-complete also (how would you verify
-     * in polynomial time?). Tried looking for the name of this optimization problem
-     * but couldn't find (didn't look too hard because its not too important for this).
-     * It's basically a variation on multiway number partition, except where the divisions
-     * must be ordered. The following seems like a fine approxmimation. Note that the
-     * the last processor tends to get more than the average amount of data.
+     * is a variation on multiway number partitioning where the divisions must be
+     * ordered. Filling processors greedily up to the average leaves all the rounding
+     * error on the last processor, which is what tended to overload it. Instead, read i
+     * goes to the processor whose share of the bases contains the start of read i, which
+     * is exactly the rule used by distributefaidx(), so both modes agree on the partition.
+     * No processor gets more than the average plus one read's worth of bases, unless a
+     * boundary has to move so that every processor gets at least one read.
+     */
+    std::fill(sendcounts.begin(), sendcounts.end(), 0);
+
+    for (const auto& record : rootrecords)
+    {
+        int dest = totbases > 0? static_cast<int>(std::min(static_cast<size_t>(nprocs-1), (basesbefore * nprocs) / totbases)) : 0;
+        sendcounts[dest]++;
+        basesbefore += record.len;
+    }
+
+    ensure_nonempty_partition(sendcounts);
+}
+
+/*
+ * Summary of the bytes of a FASTA slice that come before the first header
+ * in that slice. These bytes belong to the last record started in some
+ * earlier slice, which needs them to finish its length and line width.
+ */
+struct FaidxSliceSummary
+{
+    size_t prefixbases;     /* bases before my first header */
+    size_t hasheader;       /* 1 if my slice contains a header */
+    size_t prefixlinebases; /* bases before the first newline of my slice */
+    size_t hasnewline;      /* 1 if my slice ends a sequence line before my first header */
+    size_t newlinecrlf;     /* 1 if that line ends in "\r\n" */
+};
+
+static void faidx_summary_op(void *invec, void *inoutvec, int *len, MPI_Datatype *dtype)
+{
+    /*
+     * Segmented sum used by a right-to-left exclusive scan: @invec summarizes slices
+     * further along in the FASTA than those summarized by @inoutvec, so its bases
+     * are only added if no header (or newline, for line widths) comes first.
+     */
+    FaidxSliceSummary *far = static_cast<FaidxSliceSummary*>(invec);
+    FaidxSliceSummary *near = static_cast<FaidxSliceSummary*>(inoutvec);
+
+    for (int i = 0; i < *len; ++i)
+    {
+        if (!near[i].hasheader)
+        {
+            near[i].prefixbases += far[i].prefixbases;
+            near[i].hasheader = far[i].hasheader;
+        }
+
+        if (!near[i].hasnewline)
+        {
+            near[i].prefixlinebases += far[i].prefixlinebases;
+            near[i].hasnewline = far[i].hasnewline;
+            near[i].newlinecrlf = far[i].newlinecrlf;
+        }
+    }
+}
+
+static void faidx_linestate_op(void *invec, void *inoutvec, int *len, MPI_Datatype *dtype)
+{
+    /*
+     * Line state at the end of a slice is 1 if inside a header line, 0 if inside
+     * a sequence line, and -1 if the slice lies entirely within a single line, in
+     * which case it is inherited from the closest earlier slice that knows.
+     */
+    int *far = static_cast<int*>(invec);
+    int *near = static_cast<int*>(inoutvec);
+
+    for (int i = 0; i < *len; ++i)
+        if (near[i] < 0) near[i] = far[i];
+}
+
+void FastaIndex::writefaidx(const std::string& myfaidx) const
+{
+    int myrank = commgrid->GetRank();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    /*
+     * Index lines are written in processor rank order, which is FASTA order.
+     */
+    MPI_File faidx_fh;
+    int err = MPI_File_open(comm, get_faidx_fname().c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &faidx_fh);
+
+    if (err != MPI_SUCCESS)
+    {
+        if (myrank == 0) std::cerr << "error: could not create FASTA index file " << get_faidx_fname() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_File_set_size(faidx_fh, 0);
+    MPI_FILE_WRITE_ORDERED(faidx_fh, myfaidx.data(), static_cast<MPI_Count_type>(myfaidx.size()), MPI_CHAR, MPI_STATUS_IGNORE);
+    MPI_File_close(&faidx_fh);
+}
+
+void FastaIndex::buildfaidx()
+{
+    int myrank = commgrid->GetRank();
+    int nprocs = commgrid->GetSize();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    double elapsed = -MPI_Wtime();
+
+    MPI_File fh;
+    MPI_Offset filesize;
+    MPI_File_open(comm, fasta_fname.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_get_size(fh, &filesize);
+
+    /*
+     * Processor i scans the bytes [slicestart..sliceend) of the FASTA. It is responsible
+     * for every record whose '>' falls into its slice.
+     */
+    MPI_Offset slicestart = (filesize * myrank) / nprocs;
+    MPI_Offset sliceend = (filesize * (myrank+1)) / nprocs;
+
+    struct FaidxEntry { std::string name; size_t len, pos, bases; bool linedone, crlf; };
+    std::vector<FaidxEntry> entries;
+
+    /*
+     * A slice that doesn't begin at the start of a line begins with a fragment of a line
+     * owned by an earlier slice. We can't know yet whether that line is a header or
+     * a sequence line, so we count its bases separately until that is resolved below.
+     */
+    bool infragment = false, inheader = false, innamechars = false, atlinestart = true;
+    size_t fragbases = 0;
+    bool fragended = false, fragcrlf = false;
+
+    size_t prefixbases = 0, prefixlinebases = 0;
+    bool prefixnewline = false, prefixcrlf = false;
+
+    /*
+     * Whether the byte before the one scanned is a '\r', so that lines ending
+     * in "\r\n" get a line width one byte larger, like samtools faidx gives them.
+     */
+    bool lastcr = false;
+
+    auto scanbyte = [&](char c, MPI_Offset x)
+    {
+        bool aftercr = lastcr;
+        lastcr = (c == '\r');
+
+        if (infragment)
+        {
+            if (c == '\n') { infragment = false; fragended = true; fragcrlf = aftercr; atlinestart = true; }
+            else if (c != '\r') fragbases++;
+        }
+        else if (inheader)
+        {
+            if (c == '\n')
+            {
+                inheader = innamechars = false;
+                atlinestart = true;
+                entries.back().pos = x + 1;
+            }
+            else if (innamechars)
+            {
+                if (std::isspace(static_cast<unsigned char>(c))) innamechars = false;
+                else entries.back().name.push_back(c);
+            }
+        }
+        else if (atlinestart && c == '>')
+        {
+            entries.push_back({"", 0, static_cast<size_t>(filesize), 0, false, false});
+            inheader = innamechars = true;
+            atlinestart = false;
+        }
+        else
+        {
+            atlinestart = (c == '\n');
+
+            if (c == '\r')
+                return;
+
+            if (entries.empty())
+            {
+                if (c == '\n') { if (!prefixnewline) prefixcrlf = aftercr; prefixnewline = true; }
+                else { prefixbases++; if (!prefixnewline) prefixlinebases++; }
+            }
+            else
+            {
+                FaidxEntry& entry = entries.back();
+
+                if (c != '\n') entry.len++;
+                else if (!entry.linedone) { entry.bases = entry.len; entry.crlf = aftercr; entry.linedone = true; }
+            }
+        }
+    };
+
+    /*
+     * The slice is read in windows of bounded size so that memory use doesn't grow with
+     * the FASTA size. The first window also fetches the byte just before the slice,
+     * which tells us whether the slice begins at the start of a line.
      */
+    constexpr MPI_Offset scanwindow = 64 * 1024 * 1024;
+
+    MPI_Offset readstart = std::max(slicestart - 1, static_cast<MPI_Offset>(0));
+    MPI_Offset mynumwindows = (sliceend - readstart + scanwindow - 1) / scanwindow;
+    MPI_Offset numwindows;
+
+    MPI_ALLREDUCE(&mynumwindows, &numwindows, 1, MPI_OFFSET, MPI_MAX, comm);
+
+    std::vector<char> window(scanwindow);
+
+    for (MPI_Offset w = 0; w < numwindows; ++w)
+    {
+        MPI_Offset wstart = std::min(readstart + w * scanwindow, sliceend);
+        MPI_Offset wend = std::min(wstart + scanwindow, sliceend);
+
+        MPI_FILE_READ_AT_ALL(fh, wstart, window.data(), static_cast<MPI_Count_type>(wend - wstart), MPI_CHAR, MPI_STATUS_IGNORE);
+
+        MPI_Offset x = wstart;
+
+        if (x < slicestart)
+        {
+            atlinestart = (window[0] == '\n');
+            lastcr = (window[0] == '\r');
+            infragment = !atlinestart;
+            x++;
+        }
+
+        for (; x < wend; ++x)
+            scanbyte(window[x - wstart], x);
+    }
 
-    size_t readid = 0;
+    /*
+     * If my slice ends inside a header line then keep reading past the end of it
+     * on my own until the header is complete, so that we know the record name and
+     * where its sequence begins.
+     */
+    int endlinestate = infragment? -1 : (inheader? 1 : 0);
 
-    for (int i = 0; i < nprocs-1; ++i)
+    for (MPI_Offset x = sliceend; inheader && x < filesize; x += scanwindow)
     {
-        size_t basessofar = 0;
-        size_t startid = readid;
+        MPI_Offset wend = std::min(x + scanwindow, filesize);
+        MPI_FILE_READ_AT(fh, x, window.data(), static_cast<MPI_Count_type>(wend - x), MPI_CHAR, MPI_STATUS_IGNORE);
+
+        for (MPI_Offset y = x; inheader && y < wend; ++y)
+            scanbyte(window[y - x], y);
+    }
+
+    MPI_File_close(&fh);
+
+    /*
+     * Find out whether my leading fragment is the tail end of a header line.
+     */
+    MPI_Op linestate_op;
+    MPI_Op_create(&faidx_linestate_op, 0, &linestate_op);
+
+    int prevlinestate = 0;
+    MPI_Exscan(&endlinestate, &prevlinestate, 1, MPI_INT, linestate_op, comm);
+    if (myrank == 0) prevlinestate = 0;
+
+    MPI_Op_free(&linestate_op);
+
+    FaidxSliceSummary mysummary;
 
+    mysummary.hasheader = !entries.empty();
+
+    if (prevlinestate == 1 && fragended)
+    {
+        /*
+         * Fragment was the rest of a header line, so only the bases after it count.
+         */
+        mysummary.prefixbases = prefixbases;
+        mysummary.prefixlinebases = prefixlinebases;
+        mysummary.hasnewline = prefixnewline;
+        mysummary.newlinecrlf = prefixcrlf;
+    }
+    else if (prevlinestate == 1)
+    {
+        /*
+         * My whole slice is inside of a header line.
+         */
+        mysummary.prefixbases = mysummary.prefixlinebases = mysummary.hasnewline = mysummary.newlinecrlf = 0;
+    }
+    else
+    {
         /*
-         * Keep going through reads until the next one puts us over
-         * the average bases per processor.
+         * Fragment (if any) continues a sequence line.
          */
-        while (readid < numreads && basessofar + rootrecords[readid].len < avgbasesperproc)
+        mysummary.prefixbases = fragbases + prefixbases;
+        mysummary.prefixlinebases = fragbases + (fragended? 0 : prefixlinebases);
+        mysummary.hasnewline = fragended || prefixnewline;
+        mysummary.newlinecrlf = fragended? fragcrlf : prefixcrlf;
+    }
+
+    mysummary.hasnewline = mysummary.hasnewline || mysummary.hasheader;
+
+    /*
+     * Right-to-left exclusive scan of the slice summaries, done as a regular exclusive
+     * scan over a communicator with the processor ranks reversed. Afterwards @nextsummary
+     * holds the bases that come after my slice and before the next header.
+     */
+    MPI_Comm revcomm;
+    MPI_Comm_split(comm, 0, nprocs - 1 - myrank, &revcomm);
+
+    MPI_Datatype summary_dtype_t;
+    MPI_Type_contiguous(5, MPI_SIZE_T, &summary_dtype_t);
+    MPI_Type_commit(&summary_dtype_t);
+
+    MPI_Op summary_op;
+    MPI_Op_create(&faidx_summary_op, 0, &summary_op);
+
+    FaidxSliceSummary nextsummary = {0, 0, 0, 0, 0};
+    MPI_Exscan(&mysummary, &nextsummary, 1, summary_dtype_t, summary_op, revcomm);
+    if (myrank == nprocs-1) nextsummary = {0, 0, 0, 0, 0};
+
+    MPI_Op_free(&summary_op);
+    MPI_Type_free(&summary_dtype_t);
+    MPI_Comm_free(&revcomm);
+
+    if (!entries.empty())
+    {
+        FaidxEntry& entry = entries.back();
+
+        if (!entry.linedone)
         {
-            basessofar += rootrecords[readid].len;
-            readid++;
+            entry.bases = entry.len + nextsummary.prefixlinebases;
+            entry.crlf = nextsummary.newlinecrlf;
         }
 
-        size_t readssofar = readid - startid;
-        assert(readssofar >= 1); /* TODO: come up with a recovery strategy here */
+        entry.len += nextsummary.prefixbases;
+    }
+
+    /*
+     * Records without any newline after their first sequence line (single line
+     * records at the end of a FASTA with no trailing newline) have a single line.
+     */
+    std::ostringstream ss;
 
-        sendcounts[i] = readssofar;
+    for (const auto& entry : entries)
+    {
+        size_t bases = entry.bases > 0? entry.bases : entry.len;
+        ss << entry.name << "\t" << entry.len << "\t" << entry.pos << "\t" << bases << "\t" << bases + (entry.crlf? 2 : 1) << "\n";
     }
 
+    std::string myfaidx = ss.str();
+
+    writefaidx(myfaidx);
+
+    elapsed += MPI_Wtime();
+
+    #if LOG_LEVEL >= 2
+    double mbspersecond = ((sliceend - slicestart) / 1048576.0) / elapsed;
+    Logger logger(commgrid);
+    logger() << " indexed " << entries.size() << " records in " << std::fixed << std::setprecision(3) << elapsed << " seconds (" << std::setprecision(2) << mbspersecond << " Mbs/second)";
+    logger.Flush("FASTA index build:");
+    #endif
+}
+
+void FastaIndex::buildfqidx()
+{
+    int myrank = commgrid->GetRank();
+    int nprocs = commgrid->GetSize();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    double elapsed = -MPI_Wtime();
+
+    MPI_File fh;
+    MPI_Offset filesize;
+    MPI_File_open(comm, fasta_fname.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_get_size(fh, &filesize);
+
+    /*
+     * Processor i is responsible for every FASTQ record whose '@' falls
+     * into the bytes [slicestart..sliceend).
+     */
+    MPI_Offset slicestart = (filesize * myrank) / nprocs;
+    MPI_Offset sliceend = (filesize * (myrank+1)) / nprocs;
+
+    /*
+     * Bytes are fetched in chunks with independent reads, because how far past the
+     * end of my slice my last record extends is something that only I know.
+     */
+    MPI_Offset chunksize = std::min(static_cast<MPI_Offset>(64 * 1024 * 1024), filesize);
+    MPI_Offset chunkstart = 0, chunkend = 0;
+    std::vector<char> chunk(chunksize);
+
+    auto getbyte = [&](MPI_Offset x) -> int
+    {
+        if (x >= filesize)
+            return EOF;
+
+        if (x < chunkstart || x >= chunkend)
+        {
+            chunkstart = x;
+            chunkend = std::min(x + chunksize, filesize);
+            MPI_FILE_READ_AT(fh, chunkstart, chunk.data(), static_cast<MPI_Count_type>(chunkend - chunkstart), MPI_CHAR, MPI_STATUS_IGNORE);
+        }
+
+        return chunk[x - chunkstart];
+    };
+
+    /*
+     * Scan the line starting at @start. @len is the number of characters on the line (not
+     * counting '\r' and '\n') and @next is where the next line starts. If @name is given,
+     * it gets the characters after the first one up to the first whitespace.
+     */
+    struct FastqLine { MPI_Offset start, next; size_t len; int first; };
+
+    auto scanline = [&](MPI_Offset start, std::string *name) -> FastqLine
+    {
+        FastqLine line = {start, start, 0, getbyte(start)};
+        MPI_Offset x = start;
+        int c;
+
+        for (c = getbyte(x); c != EOF && c != '\n'; c = getbyte(++x))
+        {
+            if (c == '\r')
+                continue;
+
+            if (name && x > start)
+            {
+                if (std::isspace(c)) name = nullptr;
+                else name->push_back(static_cast<char>(c));
+            }
+
+            line.len++;
+        }
+
+        line.next = (c == EOF)? x : x + 1;
+        return line;
+    };
+
+    /*
+     * Move to the first line that starts in my slice.
+     */
+    MPI_Offset x = slicestart;
+
+    if (x > 0 && getbyte(x-1) != '\n')
+        x = scanline(x, nullptr).next;
+
     /*
-     * Last processor gets the remaining reads.
+     * A quality line can start with '@' too, so a line starting with '@' only
+     * begins a record if the line two below it starts with '+'. A quality line
+     * starting with '@' is followed by a header and then a sequence line, which
+     * never starts with '+', so this is never fooled.
      */
-    sendcounts.back() = numreads - readid;
+    while (x < sliceend)
+    {
+        FastqLine line = scanline(x, nullptr);
+
+        if (line.first == '@' && scanline(scanline(line.next, nullptr).next, nullptr).first == '+')
+            break;
+
+        x = line.next;
+    }
+
+    /*
+     * Parse my records one after the other.
+     */
+    std::ostringstream ss;
+    size_t numrecords = 0;
+
+    while (x < sliceend)
+    {
+        std::string name;
+        FastqLine header = scanline(x, &name);
+        FastqLine seq = scanline(header.next, nullptr);
+        FastqLine plus = scanline(seq.next, nullptr);
+        FastqLine qual = scanline(plus.next, nullptr);
+
+        if (header.first != '@' || plus.first != '+' || qual.len != seq.len)
+        {
+            std::cerr << "error: can't index FASTQ record at byte " << x << " of " << fasta_fname << " (only FASTQ files with single-line sequences and qualities are supported)" << std::endl;
+            MPI_Abort(comm, 1);
+        }
+
+        ss << name << "\t" << seq.len << "\t" << seq.start << "\t" << seq.len << "\t" << (seq.next - seq.start) << "\t" << qual.start << "\n";
+        numrecords++;
+
+        x = qual.next;
+    }
+
+    MPI_File_close(&fh);
+
+    writefaidx(ss.str());
+
+    elapsed += MPI_Wtime();
+
+    #if LOG_LEVEL >= 2
+    double mbspersecond = ((sliceend - slicestart) / 1048576.0) / elapsed;
+    Logger logger(commgrid);
+    logger() << " indexed " << numrecords << " records in " << std::fixed << std::setprecision(3) << elapsed << " seconds (" << std::setprecision(2) << mbspersecond << " Mbs/second)";
+    logger.Flush("FASTQ index build:");
+    #endif
 }
 
-FastaIndex::FastaIndex(const std::string& fasta_fname, std::shared_ptr<CommGrid> commgrid) : commgrid(commgrid), fasta_fname(fasta_fname)
+FastaIndex::FastaIndex(const std::string& fasta_fname, std::shared_ptr<CommGrid> commgrid, bool distributed) : commgrid(commgrid), fasta_fname(fasta_fname), distributed(distributed)
 {
     int nprocs = commgrid->GetSize();
     int myrank = commgrid->GetRank();
     MPI_Comm comm = commgrid->GetWorld();
     readcounts.resize(nprocs);
 
+    /*
+     * Root processor checks what kind of input we have and which
+     * index files are there. Input starting with '@' is FASTQ.
+     */
+    int inputinfo[5]; /* BGZF compressed, FASTQ, .fai exists, .gzi exists, .elbaseq */
+
+    if (myrank == 0)
+    {
+        inputinfo[0] = BgzfIndex::isbgzf(fasta_fname);
+        inputinfo[1] = (std::ifstream(fasta_fname).peek() == '@');
+        inputinfo[2] = std::ifstream(get_faidx_fname()).good();
+        inputinfo[3] = std::ifstream(fasta_fname + ".gzi").good();
+        inputinfo[4] = ::iselbaseq(fasta_fname);
+    }
+
+    MPI_BCAST(inputinfo, 5, MPI_INT, 0, comm);
+    bgzf = inputinfo[0];
+    elbaseq = inputinfo[4];
+
+    /*
+     * BGZF input needs both its block index and its sequence index, which
+     * "samtools faidx" creates together. We don't build those ourselves.
+     */
+    if (bgzf && !(inputinfo[2] && inputinfo[3]))
+    {
+        if (myrank == 0) std::cerr << "error: BGZF compressed input " << fasta_fname << " must first be indexed with \"samtools faidx " << fasta_fname << "\"" << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    /*
+     * Build the FASTA (or FASTQ) index ourselves if it isn't there.
+     */
+    if (!inputinfo[2] && !elbaseq)
+    {
+        if (inputinfo[1]) buildfqidx();
+        else buildfaidx();
+    }
+
+    /*
+     * An .elbaseq file carries its own index, which is always read in parallel.
+     */
+    if (elbaseq) distributed = true;
+
+    if (elbaseq) readelbaseq();
+    else if (distributed) distributefaidx();
+    else scatterfaidx();
+
+    #if LOG_LEVEL >= 2
+    Logger logger(commgrid);
+    size_t mytotbases = std::accumulate(myrecords.begin(), myrecords.end(), static_cast<size_t>(0), [](size_t sum, const auto& record) { return sum + record.len; });
+    size_t totbases;
+    MPI_ALLREDUCE(&mytotbases, &totbases, 1, MPI_SIZE_T, MPI_SUM, comm);
+    double percent_proportion = (static_cast<double>(mytotbases) / totbases) * 100.0;
+    logger() << " is responsible for sequences " << Logger::readrangestr(readdispls[myrank], readcounts[myrank]) << " (" << mytotbases << " nucleotides, " << std::fixed << std::setprecision(3) << percent_proportion << "%)";
+    logger.Flush("Fasta index construction:");
+    #endif
+}
+
+void FastaIndex::scatterfaidx()
+{
+    int nprocs = commgrid->GetSize();
+    int myrank = commgrid->GetRank();
+    MPI_Comm comm = commgrid->GetWorld();
+
     /*
      * Root processor responsible for reading and parsing FASTA
      * index file "{fasta_fname}.fai" into one record per sequence.
      */
+    std::vector<std::string> rootnames;
+
     if (myrank == 0)
     {
         std::string line, name;
@@ -165,218 +715,626 @@ FastaIndex::FastaIndex(const std::string& fasta_fname, std::shared_ptr<CommGrid>
 
     MPI_Type_free(&faidx_dtype_t);
 
-    #if LOG_LEVEL >= 2
-    Logger logger(commgrid);
-    size_t mytotbases = std::accumulate(myrecords.begin(), myrecords.end(), static_cast<size_t>(0), [](size_t sum, const auto& record) { return sum + record.len; });
-    size_t totbases;
-    MPI_ALLREDUCE(&mytotbases, &totbases, 1, MPI_SIZE_T, MPI_SUM, comm);
-    double percent_proportion = (static_cast<double>(mytotbases) / totbases) * 100.0;
-    logger() << " is responsible for sequences " << Logger::readrangestr(readdispls[myrank], readcounts[myrank]) << " (" << mytotbases << " nucleotides, " << std::fixed << std::setprecision(3) << percent_proportion << "%)";
-    logger.Flush("Fasta index construction:");
-    #endif
-}
-
-std::vector<size_t> FastaIndex::getmyreadlens() const
-{
     /*
-     *  Because we store sequence information using "array of structs"
-     *  instead of "structs of arrays", if we want a linear array
-     *  of read lengths we have to unpack them.
+     * The read names are scattered the same way, so that every processor
+     * keeps the names of the reads it owns and the root doesn't keep any others.
      */
-    std::vector<size_t> readlens(getmyreadcount());
-    std::transform(myrecords.cbegin(), myrecords.cend(), readlens.begin(), [](const auto& record) { return record.len; });
-    return readlens;
+    std::vector<size_t> rootnamelens, mynamelens(readcounts[myrank]);
+    std::vector<MPI_Count_type> charcounts(nprocs, 0);
+    std::vector<MPI_Displ_type> chardispls(nprocs);
+    std::vector<char> rootnamebuf;
+
+    if (myrank == 0)
+    {
+        rootnamelens.reserve(rootnames.size());
+
+        for (int i = 0; i < nprocs; ++i)
+            for (MPI_Displ_type j = readdispls[i]; j < readdispls[i+1]; ++j)
+            {
+                rootnamelens.push_back(rootnames[j].size());
+                rootnamebuf.insert(rootnamebuf.end(), rootnames[j].begin(), rootnames[j].end());
+                charcounts[i] += rootnames[j].size();
+            }
+
+        std::vector<std::string>().swap(rootnames);
+    }
+
+    std::exclusive_scan(charcounts.begin(), charcounts.end(), chardispls.begin(), static_cast<MPI_Displ_type>(0));
+
+    MPI_Count_type mynumchars;
+    MPI_SCATTER(charcounts.data(), 1, MPI_COUNT_TYPE, &mynumchars, 1, MPI_COUNT_TYPE, 0, comm);
+    MPI_SCATTERV(rootnamelens.data(), readcounts.data(), readdispls.data(), MPI_SIZE_T, mynamelens.data(), readcounts[myrank], MPI_SIZE_T, 0, comm);
+
+    std::vector<char> mynamebuf(mynumchars);
+    MPI_SCATTERV(rootnamebuf.data(), charcounts.data(), chardispls.data(), MPI_CHAR, mynamebuf.data(), mynumchars, MPI_CHAR, 0, comm);
+
+    mynames.reserve(readcounts[myrank]);
+
+    auto itr = mynamebuf.begin();
+
+    for (size_t len : mynamelens)
+    {
+        mynames.emplace_back(itr, itr + len);
+        itr += len;
+    }
 }
 
-DnaBuffer FastaIndex::getmydna() const
+void FastaIndex::distributefaidx()
 {
-    int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
+    int myrank = commgrid->GetRank();
     MPI_Comm comm = commgrid->GetWorld();
 
+    MPI_File fh;
+    MPI_Offset filesize;
+    MPI_File_open(comm, get_faidx_fname().c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_get_size(fh, &filesize);
+
     /*
-     * Allocate local sequence buffer.
+     * Processor i reads the bytes [slicestart..sliceend) of the FASTA index and
+     * parses every line that starts inside of that range. We also read the byte just
+     * before the slice to know whether the slice begins at the start of a line.
      */
-    auto readlens = getmyreadlens(); /* vector of local read lengths */
-    size_t bufsize = DnaBuffer::computebufsize(readlens); /* minimum number of bytes needed to 2-bit encode all the local reads */
-    DnaBuffer dnabuf(bufsize); /* initialize dnabuf by allocating @bufsize bytes */
-    size_t numreads = readlens.size(); /* number of local reads */
+    MPI_Offset slicestart = (filesize * myrank) / nprocs;
+    MPI_Offset sliceend = (filesize * (myrank+1)) / nprocs;
+    MPI_Offset readstart = std::max(slicestart - 1, static_cast<MPI_Offset>(0));
 
-    MPI_Offset startpos; /* the FASTA position that starts my local chunk of reads */
-    MPI_Offset endpos; /* the FASTA position that ends my local chunk of reads (exclusive) */
-    MPI_Offset filesize; /* the total size of the FASTA */
-    MPI_Offset readbufsize; /* endpos - startpos */
-    MPI_File fh;
+    std::vector<char> slice(sliceend - readstart);
+    MPI_FILE_READ_AT_ALL(fh, readstart, slice.data(), static_cast<MPI_Count_type>(slice.size()), MPI_CHAR, MPI_STATUS_IGNORE);
 
     /*
-     * FASTA file will be read using MPI collective I/O.
+     * @linestart is the offset into @slice of the first line that starts in my slice.
      */
-    MPI_File_open(comm, get_fasta_fname().c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
-    MPI_File_get_size(fh, &filesize);
+    size_t linestart = slicestart - readstart;
+
+    if (slicestart != 0)
+    {
+        auto nlitr = std::find(slice.begin(), slice.end(), '\n');
+        linestart = (nlitr != slice.end())? (nlitr - slice.begin()) + 1 : slice.size();
+    }
+
+    /*
+     * If the last line starting in my slice continues past the end of it, keep
+     * reading on my own until that line is complete.
+     */
+    if (linestart < slice.size() && slice.back() != '\n')
+    {
+        constexpr MPI_Offset chunksize = 4096;
+        MPI_Offset pos = sliceend;
+
+        while (pos < filesize)
+        {
+            MPI_Offset chunkend = std::min(pos + chunksize, filesize);
+            size_t oldsize = slice.size();
+
+            slice.resize(oldsize + (chunkend - pos));
+            MPI_FILE_READ_AT(fh, pos, slice.data() + oldsize, static_cast<MPI_Count_type>(chunkend - pos), MPI_CHAR, MPI_STATUS_IGNORE);
+
+            auto nlitr = std::find(slice.begin() + oldsize, slice.end(), '\n');
+
+            if (nlitr != slice.end())
+            {
+                slice.erase(nlitr + 1, slice.end());
+                break;
+            }
+
+            pos = chunkend;
+        }
+    }
+
+    MPI_File_close(&fh);
 
     /*
-     * Get start and end coordinates within FASTA of the sequences
-     * this processor requires.
+     * Parse my lines into records.
      */
-    startpos = myrecords.front().pos;
-    endpos = myrecords.back().pos + myrecords.back().len + (myrecords.back().len / myrecords.back().bases);
-    if (endpos > filesize) endpos = filesize;
+    std::vector<Record> records;
+    std::string line, name;
+
+    for (auto itr = slice.begin() + linestart; itr != slice.end(); )
+    {
+        auto nlitr = std::find(itr, slice.end(), '\n');
+        line.assign(itr, nlitr);
+
+        if (!line.empty())
+        {
+            records.push_back(get_faidx_record(line, name));
+            mynames.push_back(name);
+        }
+
+        itr = (nlitr != slice.end())? nlitr + 1 : nlitr;
+    }
+
+    std::vector<char>().swap(slice);
 
     /*
-     * Allocate a char buffer to read my FASTA chunk into to,
-     * and then do the reading.
+     * A parallel prefix sum over the read lengths tells every processor how many bases
+     * come before each of its records. Read i is then assigned to the processor whose
+     * share [p*avgbasesperproc..(p+1)*avgbasesperproc) of the bases contains the start of
+     * read i. Since this is monotone in i, each processor gets a contiguous range of reads,
+     * and since it only depends on the prefix sums every processor agrees on it. The
+     * global read counts of this partition are then adjusted exactly like getpartition()
+     * does, so that every processor gets at least one read.
      */
-    readbufsize = endpos - startpos;
-    std::unique_ptr<char[]> readbuf(new char[readbufsize]);
+    size_t mybases = std::accumulate(records.begin(), records.end(), static_cast<size_t>(0), [](size_t sum, const auto& record) { return sum + record.len; });
+    size_t basesbefore = 0, totbases;
+    size_t myfirstid = 0, mynumrecords = records.size();
+
+    MPI_Exscan(&mybases, &basesbefore, 1, MPI_SIZE_T, MPI_SUM, comm);
+    MPI_Exscan(&mynumrecords, &myfirstid, 1, MPI_SIZE_T, MPI_SUM, comm);
+    if (myrank == 0) basesbefore = myfirstid = 0;
+
+    MPI_ALLREDUCE(&mybases, &totbases, 1, MPI_SIZE_T, MPI_SUM, comm);
+
+    std::vector<MPI_Count_type> partcounts(nprocs, 0);
+    std::vector<MPI_Displ_type> partdispls(nprocs+1, 0);
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        int dest = totbases > 0? static_cast<int>(std::min(static_cast<size_t>(nprocs-1), (basesbefore * nprocs) / totbases)) : 0;
+        partcounts[dest]++;
+        basesbefore += records[i].len;
+    }
+
+    MPI_ALLREDUCE(MPI_IN_PLACE, partcounts.data(), nprocs, MPI_COUNT_TYPE, MPI_SUM, comm);
+    ensure_nonempty_partition(partcounts);
+    std::inclusive_scan(partcounts.begin(), partcounts.end(), partdispls.begin() + 1);
+
+    std::vector<MPI_Count_type> sendcounts(nprocs, 0), recvcounts(nprocs);
+    std::vector<MPI_Count_type> namesendcounts(nprocs, 0), namerecvcounts(nprocs);
+    std::vector<size_t> namelens(records.size());
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        auto destitr = std::upper_bound(partdispls.cbegin(), partdispls.cend(), static_cast<MPI_Displ_type>(myfirstid + i));
+        int dest = static_cast<int>(destitr - partdispls.cbegin()) - 1;
+
+        sendcounts[dest]++;
+        namesendcounts[dest] += mynames[i].size();
+        namelens[i] = mynames[i].size();
+    }
+
+    MPI_ALLTOALL(sendcounts.data(), 1, MPI_COUNT_TYPE, recvcounts.data(), 1, MPI_COUNT_TYPE, comm);
+    MPI_ALLTOALL(namesendcounts.data(), 1, MPI_COUNT_TYPE, namerecvcounts.data(), 1, MPI_COUNT_TYPE, comm);
+
+    std::vector<MPI_Displ_type> senddispls(nprocs), recvdispls(nprocs);
+    std::vector<MPI_Displ_type> namesenddispls(nprocs), namerecvdispls(nprocs);
+
+    std::exclusive_scan(sendcounts.begin(), sendcounts.end(), senddispls.begin(), static_cast<MPI_Displ_type>(0));
+    std::exclusive_scan(recvcounts.begin(), recvcounts.end(), recvdispls.begin(), static_cast<MPI_Displ_type>(0));
+    std::exclusive_scan(namesendcounts.begin(), namesendcounts.end(), namesenddispls.begin(), static_cast<MPI_Displ_type>(0));
+    std::exclusive_scan(namerecvcounts.begin(), namerecvcounts.end(), namerecvdispls.begin(), static_cast<MPI_Displ_type>(0));
+
+    MPI_Count_type mynumreads = recvdispls.back() + recvcounts.back();
+    MPI_Count_type mynumchars = namerecvdispls.back() + namerecvcounts.back();
 
     /*
-     * Every processor that calls @getmydna reads in its assigned chunk of data
-     * into its temporary local storage buffer (meant for raw contents of file).
+     * Send the records, name lengths, and name characters to the processors
+     * responsible for them.
      */
-    MPI_FILE_READ_AT_ALL(fh, startpos, &readbuf[0], readbufsize, MPI_CHAR, MPI_STATUS_IGNORE);
-    MPI_File_close(&fh);
+    MPI_Datatype faidx_dtype_t;
+    MPI_Type_contiguous(3, MPI_SIZE_T, &faidx_dtype_t);
+    MPI_Type_commit(&faidx_dtype_t);
 
-    size_t totbases = std::accumulate(readlens.begin(), readlens.end(), static_cast<size_t>(0), std::plus<size_t>{});
-    size_t maxlen = *std::max_element(readlens.begin(), readlens.end());
+    myrecords.resize(mynumreads);
+    MPI_ALLTOALLV(records.data(), sendcounts.data(), senddispls.data(), faidx_dtype_t, myrecords.data(), recvcounts.data(), recvdispls.data(), faidx_dtype_t, comm);
+
+    MPI_Type_free(&faidx_dtype_t);
+
+    std::vector<size_t> mynamelens(mynumreads);
+    MPI_ALLTOALLV(namelens.data(), sendcounts.data(), senddispls.data(), MPI_SIZE_T, mynamelens.data(), recvcounts.data(), recvdispls.data(), MPI_SIZE_T, comm);
+
+    std::vector<char> sendnamebuf, recvnamebuf(mynumchars);
+    sendnamebuf.reserve(std::accumulate(namelens.begin(), namelens.end(), static_cast<size_t>(0)));
+
+    for (const auto& s : mynames)
+        sendnamebuf.insert(sendnamebuf.end(), s.begin(), s.end());
+
+    MPI_ALLTOALLV(sendnamebuf.data(), namesendcounts.data(), namesenddispls.data(), MPI_CHAR, recvnamebuf.data(), namerecvcounts.data(), namerecvdispls.data(), MPI_CHAR, comm);
+
+    mynames.clear();
+    mynames.reserve(mynumreads);
+
+    auto itr = recvnamebuf.begin();
+
+    for (MPI_Count_type i = 0; i < mynumreads; ++i)
+    {
+        mynames.emplace_back(itr, itr + mynamelens[i]);
+        itr += mynamelens[i];
+    }
 
     /*
-     * ASCII sequences are first read into this temporary char buffer
-     * before they are compressed into the sequence buffer.
+     * Every processor gets a copy of the read counts and displacements.
      */
-    std::unique_ptr<char[]> tmpbuf(new char[maxlen]);
+    MPI_ALLGATHER(&mynumreads, 1, MPI_COUNT_TYPE, readcounts.data(), 1, MPI_COUNT_TYPE, comm);
 
-    MPI_Barrier(comm);
-    double elapsed = -MPI_Wtime();
+    readdispls.resize(nprocs);
+    std::exclusive_scan(readcounts.begin(), readcounts.end(), readdispls.begin(), static_cast<MPI_Displ_type>(0));
+    readdispls.push_back(readdispls.back() + readcounts.back());
+}
+
+void FastaIndex::readelbaseq()
+{
+    int nprocs = commgrid->GetSize();
+    int myrank = commgrid->GetRank();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    MPI_File fh;
+    ElbaSeqHeader header;
+
+    MPI_File_open(comm, fasta_fname.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_FILE_READ_AT_ALL(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    if (!header.valid())
+    {
+        if (myrank == 0) std::cerr << "error: " << fasta_fname << " is not a valid version " << ElbaSeqHeader::elbaseq_version << " .elbaseq file" << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    auto getbufoffset = [&](uint64_t i)
+    {
+        uint64_t offset;
+        MPI_File_read_at(fh, header.bufoffsetsoffset() + 8 * i, &offset, 1, MPI_UINT64_T, MPI_STATUS_IGNORE);
+        return offset;
+    };
 
     /*
-     * Go through each local FASTA record.
+     * Reads are partitioned by their encoded size: read i goes to the processor whose
+     * share of the buffer contains the first byte of read i, just like the distributed
+     * FASTA index partitions by bases. Each processor finds the first read of its own
+     * share and of the next one by binary searching the buffer offsets in the file.
      */
-    for (auto itr = myrecords.cbegin(); itr != myrecords.cend(); ++itr)
+    auto getfirstread = [&](int rank) -> uint64_t
     {
-        size_t locpos = 0;
-        ptrdiff_t chunkpos = itr->pos - startpos;
-        ptrdiff_t remain = itr->len;
-        char *writeptr = &tmpbuf[0];
+        if (rank >= nprocs) return header.numreads;
 
-        /*
-         * Read ASCII FASTA sequence into the temoprary buffer.
-         */
-        while (remain > 0)
+        uint64_t lo = 0, hi = header.numreads;
+
+        while (lo < hi)
         {
-            size_t cnt = std::min(itr->bases, static_cast<size_t>(remain));
-            std::memcpy(writeptr, &readbuf[chunkpos + locpos], cnt);
-            writeptr += cnt;
-            remain -= cnt;
-            locpos += (cnt+1);
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (getbufoffset(mid) * nprocs >= rank * header.bufsize) hi = mid;
+            else lo = mid + 1;
         }
 
-        /*
-         * DnaBuffer automatically 2-bit encodes the ASCII sequence
-         * and pushes it onto its local stack of sequences.
-         */
-        dnabuf.push_back(&tmpbuf[0], itr->len);
+        return lo;
+    };
+
+    uint64_t first = getfirstread(myrank);
+    uint64_t last = getfirstread(myrank+1);
+    uint64_t mynumreads = last - first;
+
+    std::vector<uint64_t> readlens(mynumreads), bufoffsets(mynumreads+1), nameoffsets(mynumreads+1);
+
+    MPI_FILE_READ_AT_ALL(fh, header.readlensoffset() + 8 * first, readlens.data(), static_cast<MPI_Count_type>(mynumreads), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_READ_AT_ALL(fh, header.bufoffsetsoffset() + 8 * first, bufoffsets.data(), static_cast<MPI_Count_type>(mynumreads+1), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_FILE_READ_AT_ALL(fh, header.nameoffsetsoffset() + 8 * first, nameoffsets.data(), static_cast<MPI_Count_type>(mynumreads+1), MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+    std::vector<char> namebuf(nameoffsets.back() - nameoffsets.front());
+    MPI_FILE_READ_AT_ALL(fh, header.namesoffset() + nameoffsets.front(), namebuf.data(), static_cast<MPI_Count_type>(namebuf.size()), MPI_CHAR, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&fh);
+
+    /*
+     * Record positions point at the encoded reads in the file, and a
+     * read is treated as a single line.
+     */
+    myrecords.resize(mynumreads);
+    mynames.reserve(mynumreads);
+
+    for (uint64_t i = 0; i < mynumreads; ++i)
+    {
+        myrecords[i].len = readlens[i];
+        myrecords[i].pos = header.bufferoffset() + bufoffsets[i];
+        myrecords[i].bases = readlens[i];
+        mynames.emplace_back(namebuf.begin() + (nameoffsets[i] - nameoffsets.front()), namebuf.begin() + (nameoffsets[i+1] - nameoffsets.front()));
     }
 
-    elapsed += MPI_Wtime();
+    MPI_Count_type mycount = static_cast<MPI_Count_type>(mynumreads);
+    MPI_ALLGATHER(&mycount, 1, MPI_COUNT_TYPE, readcounts.data(), 1, MPI_COUNT_TYPE, comm);
 
-    #if LOG_LEVEL >= 2
-    double mbspersecond = (totbases / 1048576.0) / elapsed;
-    Logger logger(commgrid);
-    logger() << std::fixed << std::setprecision(2) << mbspersecond << " Mbs/second";
-    logger.Flush("FASTA parsing rates (DnaBuffer):");
-    #endif
+    readdispls.resize(nprocs);
+    std::exclusive_scan(readcounts.begin(), readcounts.end(), readdispls.begin(), static_cast<MPI_Displ_type>(0));
+    readdispls.push_back(readdispls.back() + readcounts.back());
+}
 
-    return dnabuf;
+std::vector<size_t> FastaIndex::getmyreadlens() const
+{
+    /*
+     *  Because we store sequence information using "array of structs"
+     *  instead of "structs of arrays", if we want a linear array
+     *  of read lengths we have to unpack them.
+     */
+    std::vector<size_t> readlens(getmyreadcount());
+    std::transform(myrecords.cbegin(), myrecords.cend(), readlens.begin(), [](const auto& record) { return record.len; });
+    return readlens;
 }
 
-std::vector<std::string> FastaIndex::bcastnames()
+/*
+ * A read window is a run of consecutive local FASTA records [first..last) whose
+ * bytes are fetched from the FASTA with a single collective read.
+ */
+struct FastaWindow
+{
+    size_t first, last;
+    MPI_Offset startpos, endpos;
+    MPI_Offset readstart, readend; /* file bytes read for the window, which are the compressed blocks covering [startpos..endpos) for BGZF input */
+    MPI_Offset blockstart, blockend; /* uncompressed range covered by those blocks (BGZF input only) */
+};
+
+static MPI_Offset getrecordend(const Record& record, MPI_Offset filesize)
 {
     /*
-     * In order to print out PAF files, we need the names for each
-     * read sequence. It's easiest to just broadcast all the
-     * read names to every process (although it's not the most efficient).
+     * Position one past the last FASTA byte needed to parse @record (including
+     * the newline characters of every line of the record). An empty record
+     * has no lines, and its index entry says 0 bases per line.
      */
+    if (record.bases == 0)
+        return std::min(static_cast<MPI_Offset>(record.pos + record.len), filesize);
+
+    MPI_Offset endpos = record.pos + record.len + (record.len / record.bases);
+    return std::min(endpos, filesize);
+}
 
+DnaBuffer FastaIndex::getmydna(size_t windowsize) const
+{
     int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
     MPI_Comm comm = commgrid->GetWorld();
 
-    MPI_Count_type numchars; /* total number of characters needed for every read name */
-    MPI_Count_type numreads = gettotrecords(); /* total number of reads (and hence names) */
-    std::vector<char> flatbuf; /* this will store a flattened buffer of all the characters linearly ordered from all the names */
-    std::vector<size_t> namelens(numreads); /* vector of read name lengths for unflattening the flatbuf */
+    /*
+     * Allocate local sequence buffer.
+     */
+    auto readlens = getmyreadlens(); /* vector of local read lengths */
+    size_t bufsize = DnaBuffer::computebufsize(readlens); /* minimum number of bytes needed to 2-bit encode all the local reads */
+    size_t numreads = readlens.size(); /* number of local reads */
 
     /*
-     * At the start, the root process stores all the read names and the other
-     * processes don't know any of the names. So the root process computes the
-     * the total number of characters needed and then broadcasts them.
+     * Reads in an .elbaseq file are already 2-bit encoded and laid out exactly as
+     * in a DnaBuffer, so my part of the buffer is read straight into memory.
      */
-    if (myrank == 0)
+    if (elbaseq)
     {
-        numchars = std::accumulate(rootnames.begin(), rootnames.end(), static_cast<MPI_Count_type>(0), [](MPI_Count_type sum, const std::string& s) { return sum + s.size(); });
+        MPI_File fh;
+        ElbaSeqHeader header;
+        MPI_Offset bufstart = numreads > 0? myrecords.front().pos : 0;
+        uint64_t first = getmyreaddispl();
+        uint8_t *buf = new uint8_t[bufsize];
+
+        double elapsed = -MPI_Wtime();
+
+        MPI_File_open(comm, get_fasta_fname().c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+        MPI_FILE_READ_AT_ALL(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_FILE_READ_AT_ALL(fh, bufstart, buf, static_cast<MPI_Count_type>(bufsize), MPI_BYTE, MPI_STATUS_IGNORE);
+
+        /*
+         * My N runs, rebased so that they start at 0.
+         */
+        std::vector<uint64_t> nrunoffsets64(numreads+1);
+        MPI_FILE_READ_AT_ALL(fh, header.nrunoffsetsoffset() + 8 * first, nrunoffsets64.data(), static_cast<MPI_Count_type>(numreads+1), MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+        std::vector<uint64_t> nruns64(2 * (nrunoffsets64.back() - nrunoffsets64.front()));
+        MPI_FILE_READ_AT_ALL(fh, header.nrunsoffset() + 16 * nrunoffsets64.front(), nruns64.data(), static_cast<MPI_Count_type>(nruns64.size()), MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+        MPI_File_close(&fh);
+
+        std::vector<uint32_t> nrunoffsets(numreads+1);
+        std::vector<NRun> nruns(nruns64.size() / 2);
+
+        for (size_t i = 0; i <= numreads; ++i)
+            nrunoffsets[i] = static_cast<uint32_t>(nrunoffsets64[i] - nrunoffsets64.front());
+
+        for (size_t r = 0; r < nruns.size(); ++r)
+            nruns[r] = {static_cast<uint32_t>(nruns64[2*r]), static_cast<uint32_t>(nruns64[2*r+1])};
+
+        elapsed += MPI_Wtime();
+
+        #if LOG_LEVEL >= 2
+        Logger logger(commgrid);
+        logger() << std::fixed << std::setprecision(2) << ((bufsize / 1048576.0) / elapsed) << " Mbs/second; read " << bufsize << " encoded bytes";
+        logger.Flush("ELBASEQ reading rates (DnaBuffer):");
+        #endif
+
+        return DnaBuffer(bufsize, numreads, buf, readlens.data(), std::move(nrunoffsets), std::move(nruns));
     }
 
-    MPI_BCAST(&numchars, 1, MPI_COUNT_TYPE, 0, comm);
+    DnaBuffer dnabuf(bufsize); /* initialize dnabuf by allocating @bufsize bytes */
+
+    MPI_Offset filesize; /* the total size of the FASTA */
+    MPI_File fh;
+
+    /*
+     * FASTA file will be read using MPI collective I/O.
+     */
+    MPI_File_open(comm, get_fasta_fname().c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    MPI_File_get_size(fh, &filesize);
 
     /*
-     * The root process goes through each name in the rootnames vector
-     * and appends them onto the flat buffer. For example, if
-     * rootnames = {'read1', read2', 'read3'}, then flatbuf = "read1read2read3".
+     * Record positions of BGZF input refer to the uncompressed file, so we
+     * load the part of the block index that covers my records.
      */
-    if (myrank == 0)
+    std::unique_ptr<BgzfIndex> gzindex;
+
+    if (bgzf)
     {
-        flatbuf.reserve(numchars);
-        auto itr = rootnames.begin();
+        MPI_Offset ustart = numreads > 0? myrecords.front().pos : 0;
+        MPI_Offset uend = numreads > 0? getrecordend(myrecords.back(), std::numeric_limits<MPI_Offset>::max()) : 0;
 
-        for (size_t i = 0; i < static_cast<size_t>(numreads); ++i)
-        {
-            flatbuf.insert(flatbuf.end(), itr->begin(), itr->end()); /* appends name on the end of flatbuf */
-            namelens[i] = itr->size(); /* record the length of the name */
-            ++itr;
-        }
+        gzindex.reset(new BgzfIndex(get_fasta_fname(), ustart, uend));
+        filesize = gzindex->getusize();
     }
-    else
+
+    /*
+     * Group my records into read windows. A window is extended with the next record
+     * as long as the FASTA byte range it covers stays within @windowsize bytes. A record
+     * that is by itself larger than @windowsize gets a window of its own. When @windowsize
+     * is zero, all of my records go into a single window, which means my entire FASTA
+     * chunk is read at once.
+     */
+    std::vector<FastaWindow> windows;
+    MPI_Offset maxspan = 0; /* largest number of bytes spanned by one of my windows */
+    MPI_Offset maxreadspan = 0; /* largest number of file bytes read for one of my windows */
+    MPI_Offset maxblockspan = 0; /* largest number of bytes inflated for one of my windows */
+
+    for (size_t i = 0; i < numreads; )
     {
-        /*
-         * Non-root processes use the broadcasted flatbuf length to allocate
-         * the memory needed to store its copy of flatbuf.
-         */
-        flatbuf.resize(numchars);
+        FastaWindow window;
+        window.first = i;
+        window.startpos = myrecords[i].pos;
+        window.endpos = getrecordend(myrecords[i], filesize);
+
+        for (++i; i < numreads; ++i)
+        {
+            MPI_Offset endpos = getrecordend(myrecords[i], filesize);
+
+            if (windowsize != 0 && static_cast<size_t>(endpos - window.startpos) > windowsize)
+                break;
+
+            window.endpos = endpos;
+        }
+
+        window.last = i;
+        window.readstart = window.startpos, window.readend = window.endpos;
+
+        if (bgzf)
+        {
+            gzindex->getblockrange(window.startpos, window.endpos, window.readstart, window.readend, window.blockstart, window.blockend);
+            maxblockspan = std::max(maxblockspan, window.blockend - window.blockstart);
+        }
+
+        maxspan = std::max(maxspan, window.endpos - window.startpos);
+        maxreadspan = std::max(maxreadspan, window.readend - window.readstart);
+        windows.push_back(window);
     }
 
-    assert(flatbuf.size() == numchars);
+    /*
+     * Every processor has to participate in the same number of collective reads,
+     * so processors with fewer windows pad the remaining rounds with empty reads.
+     */
+    size_t mynumwindows = windows.size();
+    size_t numwindows;
+    MPI_ALLREDUCE(&mynumwindows, &numwindows, 1, MPI_SIZE_T, MPI_MAX, comm);
 
     /*
-     * Broadcast the name lengths and the flat buffer.
+     * Allocate two window buffers so that the next window can be read while
+     * the current one is being 2-bit encoded. The second buffer is only needed
+     * if some processor has more than one window.
      */
-    MPI_BCAST(namelens.data(), numreads, MPI_SIZE_T, 0, comm);
-    MPI_BCAST(flatbuf.data(), numchars, MPI_CHAR, 0, comm);
+    std::unique_ptr<char[]> readbufs[2];
+    MPI_Request readreqs[2];
+
+    readbufs[0].reset(new char[maxreadspan]);
+    if (numwindows > 1) readbufs[1].reset(new char[maxreadspan]);
 
     /*
-     * Root process can return immediately because its
-     * vector of names has already been computed.
+     * BGZF windows are inflated into this buffer before they are parsed.
      */
-    if (myrank == 0)
+    std::unique_ptr<char[]> blockbuf(new char[maxblockspan]);
+
+    auto postread = [&](size_t w)
     {
-        return rootnames;
-    }
+        char *readbuf = readbufs[w&1].get();
+
+        if (w < mynumwindows)
+            MPI_FILE_IREAD_AT_ALL(fh, windows[w].readstart, readbuf, windows[w].readend - windows[w].readstart, MPI_CHAR, &readreqs[w&1]);
+        else
+            MPI_FILE_IREAD_AT_ALL(fh, 0, readbuf, 0, MPI_CHAR, &readreqs[w&1]);
+    };
 
     /*
-     * Non-root processes have to unpack flatbuf using the
-     * name lengths before returning.
+     * Multi-line FASTA sequences are first gathered into this temporary
+     * char buffer before they are compressed into the sequence buffer.
+     * Single-line sequences are compressed straight out of the window buffer.
      */
-    std::vector<std::string> recvnames;
-    recvnames.reserve(numreads);
+    size_t maxlen = 0;
+
+    for (auto itr = myrecords.cbegin(); itr != myrecords.cend(); ++itr)
+        if (itr->bases < itr->len)
+            maxlen = std::max(maxlen, itr->len);
+
+    std::unique_ptr<char[]> tmpbuf(new char[maxlen]);
 
-    auto itr = flatbuf.begin();
+    size_t totbases = std::accumulate(readlens.begin(), readlens.end(), static_cast<size_t>(0), std::plus<size_t>{});
+    double elapsed = 0;
 
-    for (size_t i = 0; i < static_cast<size_t>(numreads); ++i)
+    if (numwindows > 0) postread(0);
+
+    for (size_t w = 0; w < numwindows; ++w)
     {
-        recvnames.emplace_back(itr, itr + namelens[i]);
-        itr += namelens[i];
+        /*
+         * Start reading the next window before parsing the current one.
+         */
+        if (w+1 < numwindows) postread(w+1);
+
+        MPI_Wait(&readreqs[w&1], MPI_STATUS_IGNORE);
+
+        if (w >= mynumwindows)
+            continue;
+
+        elapsed -= MPI_Wtime();
+
+        const char *readbuf = readbufs[w&1].get();
+        const FastaWindow& window = windows[w];
+
+        /*
+         * Inflate the BGZF blocks of the window and point @readbuf at
+         * the uncompressed byte at position @window.startpos.
+         */
+        if (bgzf)
+        {
+            BgzfIndex::inflateblocks(readbuf, window.readend - window.readstart, blockbuf.get(), window.blockend - window.blockstart);
+            readbuf = blockbuf.get() + (window.startpos - window.blockstart);
+        }
+
+        /*
+         * Go through each FASTA record in the window.
+         */
+        for (size_t i = window.first; i < window.last; ++i)
+        {
+            const Record& record = myrecords[i];
+            const char *chunkptr = readbuf + (record.pos - window.startpos);
+
+            if (record.bases >= record.len || record.bases == 0)
+            {
+                dnabuf.push_back(chunkptr, record.len);
+                continue;
+            }
+
+            size_t locpos = 0;
+            ptrdiff_t remain = record.len;
+            char *writeptr = &tmpbuf[0];
+
+            /*
+             * Read ASCII FASTA sequence into the temporary buffer.
+             */
+            while (remain > 0)
+            {
+                size_t cnt = std::min(record.bases, static_cast<size_t>(remain));
+                std::memcpy(writeptr, chunkptr + locpos, cnt);
+                writeptr += cnt;
+                remain -= cnt;
+                locpos += (cnt+1);
+            }
+
+            /*
+             * DnaBuffer automatically 2-bit encodes the ASCII sequence
+             * and pushes it onto its local stack of sequences.
+             */
+            dnabuf.push_back(&tmpbuf[0], record.len);
+        }
+
+        elapsed += MPI_Wtime();
     }
 
-    return recvnames;
+    MPI_File_close(&fh);
+
+    #if LOG_LEVEL >= 2
+    double mbspersecond = (totbases / 1048576.0) / elapsed;
+    Logger logger(commgrid);
+    logger() << std::fixed << std::setprecision(2) << mbspersecond << " Mbs/second; " << mynumwindows << " read windows of at most " << (maxspan / 1048576.0) << " Mbs";
+    logger.Flush("FASTA parsing rates (DnaBuffer):");
+    #endif
+
+    return dnabuf;
 }
 
 void FastaIndex::log(const DnaBuffer& buffer) const
@@ -388,6 +1346,7 @@ void FastaIndex::log(const DnaBuffer& buffer) const
     size_t totbases = std::accumulate(readlens.begin(), readlens.end(), static_cast<size_t>(0), std::plus<size_t>{});
     double avglen = static_cast<double>(totbases) / numreads;
     size_t firstid = getmyreaddispl();
-    logger() << " stores " << Logger::readrangestr(firstid, numreads) << ". ~" << std::fixed << std::setprecision(2) << avglen << " nts/read. (" << static_cast<double>(buffer.getbufsize()) / (1024.0 * 1024.0) << " Mbs compressed) == (" << buffer.getbufsize() << " bytes)";
+    size_t totnbases = std::accumulate(buffer.getallnruns().begin(), buffer.getallnruns().end(), static_cast<size_t>(0), [](size_t sum, const NRun& nrun) { return sum + (nrun.end - nrun.begin); });
+    logger() << " stores " << Logger::readrangestr(firstid, numreads) << ". ~" << std::fixed << std::setprecision(2) << avglen << " nts/read. (" << static_cast<double>(buffer.getbufsize()) / (1024.0 * 1024.0) << " Mbs compressed) == (" << buffer.getbufsize() << " bytes). " << buffer.getallnruns().size() << " N runs (" << totnbases << " Ns). " << buffer.getmetadatasize() << " bytes of read metadata";
     logger.Flush("FASTA sequence storage (DnaBuffer):");
 }
@@ -0,0 +1,87 @@
+#include "HpcBuffer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+/*
+ * Calls @f(base, runlen) for every run of identical bases of read @i of @dna,
+ * in order. Bases within N runs are reported as 'N'.
+ */
+template <typename F>
+static void foreachrun(const DnaBuffer& dna, size_t i, F&& f)
+{
+    static char const *bases = "ACGT";
+
+    const DnaSeq sequence = dna[i];
+    const NRun *nruns = dna.getnruns(i);
+    size_t numnruns = dna.getnumnruns(i);
+    size_t len = sequence.size();
+    size_t r = 0;
+
+    auto getbase = [&](size_t p)
+    {
+        while (r < numnruns && nruns[r].end <= p) ++r;
+        return (r < numnruns && nruns[r].begin <= p)? 'N' : bases[sequence[p]];
+    };
+
+    size_t p = 0;
+
+    while (p < len)
+    {
+        char base = getbase(p);
+        size_t runlen = 1;
+
+        while (p + runlen < len && getbase(p + runlen) == base)
+            ++runlen;
+
+        f(base, runlen);
+        p += runlen;
+    }
+}
+
+static size_t gethpcbufsize(const DnaBuffer& dna)
+{
+    size_t bufsize = 0;
+
+    for (size_t i = 0; i < dna.size(); ++i)
+    {
+        size_t hpclen = 0;
+        foreachrun(dna, i, [&](char base, size_t runlen) { ++hpclen; });
+        bufsize += DnaSeq::bytesneeded(hpclen);
+    }
+
+    return bufsize;
+}
+
+HpcBuffer::HpcBuffer(const DnaBuffer& dna) : hpcdna(gethpcbufsize(dna)), runoffsets(1, 0)
+{
+    std::string hpcread;
+
+    for (size_t i = 0; i < dna.size(); ++i)
+    {
+        hpcread.clear();
+
+        foreachrun(dna, i, [&](char base, size_t runlen)
+        {
+            if (runlen > std::numeric_limits<uint8_t>::max())
+            {
+                assert(runlen <= std::numeric_limits<uint32_t>::max());
+                longruns.emplace_back(runlens.size(), static_cast<uint32_t>(runlen));
+                runlen = 0;
+            }
+
+            hpcread.push_back(base);
+            runlens.push_back(static_cast<uint8_t>(runlen));
+        });
+
+        hpcdna.push_back(hpcread.data(), hpcread.size());
+        runoffsets.push_back(runlens.size());
+    }
+}
+
+size_t HpcBuffer::getlongrunlen(size_t run) const
+{
+    auto itr = std::lower_bound(longruns.begin(), longruns.end(), std::make_pair(run, static_cast<uint32_t>(0)));
+    assert(itr != longruns.end() && itr->first == run);
+    return itr->second;
+}
@@ -35,7 +35,7 @@ template <int NLONGS>
 Kmer<NLONGS>::Kmer() : longs{} {}
 
 template <int NLONGS>
-Kmer<NLONGS>::Kmer(const DnaSeq& s) : Kmer() { set_kmer(s); }
+Kmer<NLONGS>::Kmer(const DnaSeq& s, size_t pos) : Kmer() { set_kmer(s, pos); }
 
 template <int NLONGS>
 Kmer<NLONGS>::Kmer(char const *s) : Kmer() { set_kmer(s); }
@@ -65,24 +65,18 @@ std::string Kmer<NLONGS>::GetString() const
 }
 
 template <int NLONGS>
-void Kmer<NLONGS>::set_kmer(const DnaSeq& s)
+void Kmer<NLONGS>::set_kmer(const DnaSeq& s, size_t pos)
 {
-    int i, j, l, idx;
-    uint64_t code;
-
     /*
-     * Warning: set_kmer assumes that longs/bytes have already
-     * been completely zeroed out.
+     * DnaSeq::getword already packs 32 nucleotides in the same
+     * layout as our longs, so we only have to clear the bits
+     * past KMER_SIZE in the last one.
      */
 
-    for (i = 0; i < KMER_SIZE; ++i)
+    for (int l = 0; l < NLONGS; ++l)
     {
-        j = i % 32;
-        l = i / 32;
-
-        code = static_cast<uint64_t>(s[i]);
-
-        longs[l] |= (code << (2 * (31 - j)));
+        int n = std::min(KMER_SIZE - 32*l, 32);
+        longs[l] = n > 0? s.getword(pos + 32*l) & (~0ULL << (2 * (32 - n))) : 0;
     }
 }
 
@@ -197,6 +191,32 @@ Kmer<NLONGS> Kmer<NLONGS>::GetTwin() const
     return twin;
 }
 
+/*
+ * Drop the first nucleotide and append nucleotide @code, in place.
+ */
+template <int NLONGS>
+void Kmer<NLONGS>::roll_forward(uint64_t code)
+{
+    for (int l = 0; l < NLONGS-1; ++l)
+        longs[l] = (longs[l] << 2) | (longs[l+1] >> 62);
+
+    longs[NLONGS-1] = (longs[NLONGS-1] << 2) | (code << (2 * (31 - ((KMER_SIZE-1) % 32))));
+}
+
+/*
+ * Same for the reverse complement: drop the last nucleotide and prepend the
+ * complement of @code, in place.
+ */
+template <int NLONGS>
+void Kmer<NLONGS>::roll_twin(uint64_t code)
+{
+    for (int l = NLONGS-1; l > 0; --l)
+        longs[l] = (longs[l] >> 2) | (longs[l-1] << 62);
+
+    longs[0] = (longs[0] >> 2) | ((3 - code) << 62);
+    longs[NLONGS-1] &= ~0ULL << (2 * (31 - ((KMER_SIZE-1) % 32)));
+}
+
 template <int NLONGS>
 Kmer<NLONGS> Kmer<NLONGS>::GetRep() const
 {
@@ -215,7 +235,13 @@ uint64_t Kmer<NLONGS>::GetHash() const
 template <int NLONGS>
 std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetKmers(const DnaSeq& s)
 {
-    int l = s.size();
+    return GetKmers(s, 0, s.size());
+}
+
+template <int NLONGS>
+std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetKmers(const DnaSeq& s, size_t begin, size_t end)
+{
+    int l = end - begin;
     int num_kmers = l - KMER_SIZE + 1;
 
     if (num_kmers <= 0) return std::vector<Kmer>();
@@ -223,11 +249,20 @@ std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetKmers(const DnaSeq& s)
     std::vector<Kmer> kmers;
 
     kmers.reserve(num_kmers);
-    kmers.emplace_back(s);
+    kmers.emplace_back(s, begin);
+
+    uint64_t incoming = 0;
 
     for (int i = 1; i < num_kmers; ++i)
     {
-        kmers.push_back(kmers.back().GetExtension(s[i+KMER_SIZE-1]));
+        /*
+         * Fetch the next 32 nucleotides entering the window
+         * at once rather than one operator[] call at a time.
+         */
+        if ((i - 1) % 32 == 0) incoming = s.getword(begin+i+KMER_SIZE-1);
+
+        kmers.push_back(kmers.back().GetExtension(incoming >> 62));
+        incoming <<= 2;
     }
 
     return kmers;
@@ -236,7 +271,47 @@ std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetKmers(const DnaSeq& s)
 template <int NLONGS>
 std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetRepKmers(const DnaSeq& s)
 {
-    auto kmers = GetKmers(s);
-    std::transform(kmers.begin(), kmers.end(), kmers.begin(), [](const Kmer& kmer) { return kmer.GetRep(); });
+    return GetRepKmers(s, 0, s.size());
+}
+
+template <int NLONGS>
+std::vector<Kmer<NLONGS>> Kmer<NLONGS>::GetRepKmers(const DnaSeq& s, size_t begin, size_t end)
+{
+    std::vector<Kmer> kmers;
+
+    if (end >= begin + KMER_SIZE) kmers.reserve(end - begin - KMER_SIZE + 1);
+
+    ForeachRepKmer(s, begin, end, [&](const Kmer& repmer, size_t i) { kmers.push_back(repmer); });
     return kmers;
 }
+
+template <int NLONGS>
+template <typename F>
+void Kmer<NLONGS>::ForeachRepKmer(const DnaSeq& s, size_t begin, size_t end, F&& f)
+{
+    if (end < begin + KMER_SIZE) return;
+
+    Kmer kmer(s, begin);
+    Kmer twin = kmer.GetTwin();
+
+    f(twin < kmer? twin : kmer, begin);
+
+    uint64_t incoming = 0;
+
+    for (size_t i = begin + 1; i + KMER_SIZE <= end; ++i)
+    {
+        /*
+         * Fetch the next 32 nucleotides entering the window
+         * at once rather than one operator[] call at a time.
+         */
+        if ((i - begin - 1) % 32 == 0) incoming = s.getword(i+KMER_SIZE-1);
+
+        uint64_t code = incoming >> 62;
+        incoming <<= 2;
+
+        kmer.roll_forward(code);
+        twin.roll_twin(code);
+
+        f(twin < kmer? twin : kmer, i);
+    }
+}
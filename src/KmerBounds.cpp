@@ -0,0 +1,109 @@
+#include "KmerBounds.hpp"
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+
+std::string KmerBounds::Check() const
+{
+    if (lower < 1 || lower > upper)
+        return "k-mer frequency bounds must satisfy 1 <= lower <= upper";
+
+    /*
+     * The k-mer counts saturate at INT_MAX, and the histogram that
+     * automatic bounds are picked from goes up to 4 times the upper bound.
+     */
+    if (upper >= (IsAutomatic()? std::numeric_limits<int>::max() / 4 : std::numeric_limits<int>::max()))
+        return "upper k-mer frequency bound is too large";
+
+    if (minprob < 0 || minprob >= 1)
+        return "k-mer bound probability must be between 0 and 1";
+
+    /*
+     * The lower bound is picked from 2 up, like elba_bounds.py does.
+     */
+    if (IsAutomatic() && upper < 2)
+        return "automatic k-mer frequency bounds need an upper bound of at least 2";
+
+    return "";
+}
+
+std::string KmerBounds::GetString() const
+{
+    std::ostringstream ss;
+
+    ss << "[" << lower << ", " << upper << "]";
+
+    if (IsAutomatic() && depth)
+        ss << " (k-mer coverage " << kmercoverage << ", depth " << depth << ", error rate " << std::setprecision(3) << std::fixed << errorrate << ")";
+    else if (IsAutomatic())
+        ss << " (picked from the k-mer counts, upper at most " << upper << ")";
+
+    return ss.str();
+}
+
+bool KmerBounds::Select(const std::vector<int64_t>& histo, int64_t numcounted, int64_t numkmers)
+{
+    int last = static_cast<int>(histo.size()) - 1;
+    int valley = 2;
+
+    /*
+     * The erroneous k-mers are the ones before the first rise of the histogram,
+     * and the reliable k-mers peak at their coverage somewhere after it.
+     */
+    while (valley + 1 < last && histo[valley] >= histo[valley+1])
+        valley++;
+
+    if (valley + 1 >= last)
+        return false;
+
+    int peak = valley + 1;
+
+    for (int m = peak + 1; m < last; ++m)
+        if (histo[m] > histo[peak])
+            peak = m;
+
+    /*
+     * Every occurrence of a reliable k-mer was read without error, and nearly every
+     * other k-mer occurrence (singletons included) was not, so the fraction of the
+     * parsed k-mers that were counted past the valley is about p.
+     */
+    int64_t numreliable = numcounted;
+
+    for (int m = 1; m < valley; ++m)
+        numreliable -= m * histo[m];
+
+    double p = std::min(static_cast<double>(numreliable) / std::max(numkmers, static_cast<int64_t>(1)), 1.0 - 1e-9);
+
+    if (p <= 0)
+        return false;
+
+    int d = static_cast<int>(std::lround(peak / p));
+
+    /*
+     * Probability that a genome k-mer is seen exactly m times, computed
+     * in log space since the binomial coefficient can be huge.
+     */
+    auto prob = [&](int m)
+    {
+        return std::exp(std::lgamma(d + 1.0) - std::lgamma(m + 1.0) - std::lgamma(d - m + 1.0) + m * std::log(p) + (d - m) * std::log1p(-p));
+    };
+
+    double sum = 0;
+    int l, u;
+
+    for (l = 2; l < d && (sum += prob(l)) < minprob; ++l);
+
+    sum = 0;
+
+    for (u = d; u > 0 && (sum += prob(u)) < minprob; --u);
+
+    upper = std::min(u, upper);
+    lower = std::min(l, upper);
+    kmercoverage = peak;
+    depth = d;
+    errorrate = 1.0 - std::pow(p, 1.0 / KMER_SIZE);
+
+    return true;
+}
@@ -0,0 +1,160 @@
+#include "KmerCountMap.hpp"
+#include <limits>
+#include <iostream>
+#include <cassert>
+
+void KmerCountMap::reserve(size_t n)
+{
+    /*
+     * Keep the load factor at most 7/8.
+     */
+    size_t minslots = n + n / 7 + 1;
+
+    if (minslots > slots.size())
+        grow(minslots);
+}
+
+const KmerCountMap::Entry* KmerCountMap::find(const TKmer& kmer) const
+{
+    if (!numentries) return nullptr;
+
+    size_t i = home(kmer.GetHash());
+
+    for (uint16_t d = 1; dists[i] >= d; ++d)
+    {
+        if (dists[i] == d && slots[i].kmer == kmer)
+            return &slots[i];
+
+        i = (i + 1) & mask;
+    }
+
+    return nullptr;
+}
+
+KmerCountMap::Entry& KmerCountMap::insert(const TKmer& kmer, uint64_t hash)
+{
+    if (numentries)
+    {
+        size_t i = home(hash);
+
+        for (uint16_t d = 1; dists[i] >= d; ++d)
+        {
+            if (dists[i] == d && slots[i].kmer == kmer)
+                return slots[i];
+
+            i = (i + 1) & mask;
+        }
+    }
+
+    if ((numentries + 1) * 8 > slots.size() * 7)
+        grow(2 * slots.size());
+
+    /*
+     * Robin Hood: walk from the home slot, and whenever the entry we carry is
+     * further from its home than the one in the slot, swap them and carry on
+     * with the displaced entry.
+     */
+    Entry carried = {kmer, 0, 0};
+    uint16_t d = 1;
+    size_t i = home(hash);
+    size_t placed = std::numeric_limits<size_t>::max();
+
+    while (dists[i])
+    {
+        if (dists[i] < d)
+        {
+            std::swap(carried, slots[i]);
+            std::swap(d, dists[i]);
+
+            if (placed == std::numeric_limits<size_t>::max())
+                placed = i;
+        }
+
+        i = (i + 1) & mask;
+        d++;
+
+        /*
+         * Probe sequences this long only happen with a broken hash.
+         */
+        assert(d < std::numeric_limits<uint16_t>::max());
+    }
+
+    slots[i] = carried;
+    dists[i] = d;
+    numentries++;
+
+    return slots[placed == std::numeric_limits<size_t>::max()? i : placed];
+}
+
+void KmerCountMap::erase(const TKmer& kmer)
+{
+    const Entry *entry = find(kmer);
+
+    if (entry) eraseslot(entry - slots.data());
+}
+
+void KmerCountMap::eraseslot(size_t i)
+{
+    /*
+     * Backward shift: pull the following entries one slot closer to their
+     * homes until one is already at home or the slot is empty.
+     */
+    size_t j = (i + 1) & mask;
+
+    while (dists[j] > 1)
+    {
+        slots[i] = slots[j];
+        dists[i] = dists[j] - 1;
+        i = j;
+        j = (j + 1) & mask;
+    }
+
+    dists[i] = 0;
+    numentries--;
+}
+
+void KmerCountMap::allocateoccurrences()
+{
+    size_t numoccurrences = 0;
+
+    foreach([&](Entry& entry)
+    {
+        entry.offset = static_cast<uint32_t>(numoccurrences);
+        numoccurrences += entry.count;
+        entry.count = 0;
+    });
+
+    /*
+     * The offsets are 32 bits to keep the table entries small.
+     */
+    if (numoccurrences > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << "error: " << numoccurrences << " k-mer occurrences on one processor, but at most " << std::numeric_limits<uint32_t>::max()
+                  << " fit in its k-mer table; use more processors or sample the k-mers (-s, -m, -y, -Y)" << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    readids.resize(numoccurrences);
+    positions.resize(numoccurrences);
+}
+
+void KmerCountMap::grow(size_t minslots)
+{
+    size_t numslots = 16;
+
+    while (numslots < minslots)
+        numslots <<= 1;
+
+    std::vector<Entry> oldslots(numslots);
+    std::vector<uint16_t> olddists(numslots, 0);
+
+    oldslots.swap(slots);
+    olddists.swap(dists);
+
+    mask = numslots - 1;
+    numentries = 0;
+
+    for (size_t i = 0; i < oldslots.size(); ++i)
+        if (olddists[i])
+            insert(oldslots[i].kmer, oldslots[i].kmer.GetHash()) = oldslots[i];
+}
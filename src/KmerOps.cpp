@@ -4,6 +4,7 @@
 #include "Logger.hpp"
 #include "DnaSeq.hpp"
 #include <cstring>
+#include <cstdio>
 #include <numeric>
 #include <algorithm>
 #include <iomanip>
@@ -15,39 +16,36 @@ static Bloom *bm = nullptr;
 static_assert(USE_BLOOM == 0);
 #endif
 
-std::unique_ptr<KmerCountMap>
-get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid)
+/*
+ * Estimate of the number of distinct k-mers in the entire FASTA, merged
+ * from the HyperLogLog counters of every processor.
+ */
+static double estimate_kmer_cardinality(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid, const KmerSampling& sampling)
 {
-    int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
+    int nthreads = omp_get_max_threads();
 
-    KmerCountMap *kmermap;                                         /* Received k-mers will be stored in this local hash table */
     HyperLogLog hll;                                               /* HyperLogLog counter initialized with 12 bits as default */
-    size_t numreads;                                               /* Number of locally stored reads */
     size_t avgcardinality;                                         /* Average estimate for number of distinct k-mers per procesor (via Hyperloglog)*/
     double cardinality;                                            /* Total estimate for number of distinct k-mers in dataset (via Hyperloglog) */
     double mycardinality;                                          /* Local estimate for number of distinct k-mers originating on my processor (via Hyperloglog) */
-    std::vector<std::vector<TKmer>> kmerbuckets(nprocs);           /* My processor's outgoing k-mer seed buckets, one for each destination processor */
-    std::vector<MPI_Count_type> sendcnt(nprocs), recvcnt(nprocs);  /* My processor's ALLTOALL send and receive counts for phase one k-mer exchange */
-    std::vector<MPI_Displ_type> sdispls(nprocs), rdispls(nprocs);  /* My processor's ALLTOALL send and receive displacements */
-    std::vector<uint8_t> sendbuf, recvbuf;                         /* My processor's ALLTOALL send and receive buffers of k-mers (packed) */
-    size_t totsend, totrecv;                                       /* My processor's total number of send and receive bytes */
-    size_t numkmerseeds;                                           /* Total number of k-mer seeds received by my processor after unpacked receive buffer */
+    std::vector<HyperLogLog> threadhlls(nthreads);                 /* My threads' HyperLogLog counters, merged into @hll */
     Logger logger(commgrid);
     std::ostringstream rootlog;
 
-    kmermap = new KmerCountMap;
-    numreads = myreads.size();
-
     /*
      * Estimate the number of distinct k-mers in my local FASTA partition.
      */
-    KmerEstimateHandler estimator(hll);
-    ForeachKmer(myreads, estimator);
+    std::vector<KmerEstimateHandler> estimators(threadhlls.begin(), threadhlls.end());
+    ForeachKmer(myreads, estimators, 0, myreads.size(), sampling);
+
+    for (const HyperLogLog& threadhll : threadhlls)
+        hll.merge(threadhll);
+
     mycardinality = hll.estimate();
 
     #if LOG_LEVEL >= 2
-    logger() << std::setprecision(3) << std::fixed << mycardinality << " k-mers";
+    logger() << std::setprecision(3) << std::fixed << mycardinality << " k-mers (" << nthreads << " threads)";
     logger.Flush("K-mer cardinality estimate");
     #endif
 
@@ -61,10 +59,112 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
     avgcardinality = static_cast<size_t>(std::ceil(cardinality / nprocs));
 
     #if LOG_LEVEL >= 2
+    rootlog << "seeding with " << sampling.GetString() << std::endl;
     rootlog << "global 'column' k-mer cardinality (merging all " << nprocs << " procesors results) is " << std::setprecision(3) << std::fixed << cardinality << ", or an average of " << avgcardinality << " per processor" << std::endl;
     logger.Flush(rootlog, 0);
     #endif
 
+    return cardinality;
+}
+
+/*
+ * Bytes held by the per-thread outgoing buckets, which keep their capacity between rounds.
+ */
+template <typename T>
+static size_t get_bucket_bytes(const std::vector<std::vector<std::vector<T>>>& threadbuckets)
+{
+    size_t bytes = 0;
+
+    for (const auto& buckets : threadbuckets)
+        for (const auto& bucket : buckets)
+            bytes += bucket.capacity() * sizeof(T);
+
+    return bytes;
+}
+
+#if LOG_LEVEL >= 2
+/*
+ * Logs the memory a round of k-mer exchange held on to at its peak: the parsed
+ * k-mers in their buckets, the send and receive buffers, and the hash table.
+ */
+static void log_round_memory(Logger& logger, size_t bucketbytes, size_t sendbytes, size_t recvbytes, const KmerCountMap& kmermap)
+{
+    constexpr double mb = 1024.0 * 1024.0;
+
+    logger() << std::setprecision(2) << std::fixed << " (memory: " << (bucketbytes / mb) << " MB buckets, " << (sendbytes / mb) << " MB send buffer, "
+             << (recvbytes / mb) << " MB receive buffer, " << ((kmermap.gettablesize() + kmermap.getoccurrencesize()) / mb) << " MB hash table)";
+}
+#endif
+
+std::vector<int64_t> get_kmer_histogram(const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, int maxcount)
+{
+    std::vector<int64_t> histo(maxcount+1, 0);
+
+    kmermap.foreach([&](const KmerCountMap::Entry& entry) { histo[std::min(entry.count, maxcount)]++; });
+
+    MPI_Allreduce(MPI_IN_PLACE, histo.data(), maxcount+1, MPI_INT64_T, MPI_SUM, commgrid->GetWorld());
+
+    return histo;
+}
+
+/*
+ * If @bounds are automatic, picks them from the exact counts in @kmermap, my processor
+ * having received @mynumkmers k-mers in all. Every processor picks the same bounds.
+ */
+static void select_kmer_bounds(const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, size_t mynumkmers, KmerBounds& bounds)
+{
+    if (!bounds.IsAutomatic())
+        return;
+
+    int64_t totals[2] = {static_cast<int64_t>(mynumkmers), 0}; /* k-mers parsed, and counted in @kmermap */
+
+    kmermap.foreach([&](const KmerCountMap::Entry& entry) { totals[1] += entry.count; });
+
+    MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_INT64_T, MPI_SUM, commgrid->GetWorld());
+
+    /*
+     * Counts well past the largest upper bound that may be
+     * picked don't tell anything about the reliable k-mers.
+     */
+    std::vector<int64_t> histo = get_kmer_histogram(kmermap, commgrid, 4 * bounds.upper);
+    bool selected = bounds.Select(histo, totals[1], totals[0]);
+
+    if (!commgrid->GetRank())
+    {
+        if (!selected) std::cout << "warning: no valley in the k-mer histogram to pick k-mer bounds from, keeping ";
+        else std::cout << "picked k-mer bounds ";
+
+        std::cout << bounds.GetString() << "\n" << std::endl;
+    }
+
+    bounds.minprob = 0;
+}
+
+std::unique_ptr<KmerCountMap>
+get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid, KmerBounds& bounds, const KmerSampling& sampling, size_t batchmem)
+{
+    int myrank = commgrid->GetRank();
+    int nprocs = commgrid->GetSize();
+    int nthreads = omp_get_max_threads();
+
+    KmerCountMap *kmermap;                                         /* Received k-mers will be stored in this local hash table */
+    size_t avgcardinality;                                         /* Average estimate for number of distinct k-mers per procesor (via Hyperloglog)*/
+    double cardinality;                                            /* Total estimate for number of distinct k-mers in dataset (via Hyperloglog) */
+    std::vector<std::vector<std::vector<TKmer>>> threadbuckets;    /* My threads' outgoing k-mer buckets, one for each destination processor */
+    std::vector<KmerPartitionHandler> partitioners;                /* My threads' k-mer partitioners, filling @threadbuckets */
+    std::vector<MPI_Count_type> sendcnt(nprocs), recvcnt(nprocs);  /* My processor's ALLTOALL send and receive counts for phase one k-mer exchange */
+    std::vector<MPI_Displ_type> sdispls(nprocs), rdispls(nprocs);  /* My processor's ALLTOALL send and receive displacements */
+    std::vector<uint8_t> sendbuf, recvbuf;                         /* My processor's ALLTOALL send and receive buffers of k-mers (packed) */
+    size_t totsend, totrecv;                                       /* My processor's total number of send and receive bytes */
+    size_t numkmerseeds;                                           /* Total number of k-mer seeds received by my processor after unpacked receive buffer */
+    Logger logger(commgrid);
+    std::ostringstream rootlog;
+
+    kmermap = new KmerCountMap;
+
+    cardinality = estimate_kmer_cardinality(myreads, commgrid, sampling);
+    avgcardinality = static_cast<size_t>(std::ceil(cardinality / nprocs));
+
     /*
      * Reserve memory for local hash table and Bloom filter using
      * distinct k-mer count estimates.
@@ -72,7 +172,12 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
     kmermap->reserve(avgcardinality);
     bm = new Bloom(static_cast<int64_t>(std::ceil(cardinality)), 0.05);
 
-    BatchState batch_state(myreads.size(), commgrid);
+    BatchState batch_state(myreads.size(), commgrid, TKmer::NBYTES, batchmem);
+
+    threadbuckets.resize(nthreads, std::vector<std::vector<TKmer>>(nprocs));
+
+    for (auto& kmerbuckets : threadbuckets)
+        partitioners.emplace_back(kmerbuckets);
 
     int batch_round = 1;
 
@@ -96,13 +201,18 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
          * immediately queried against a Bloom filter and hash table keyed
          * by the distinct k-mer.
          */
-        KmerPartitionHandler partitioner(kmerbuckets);
-        ForeachKmer(myreads, partitioner, batch_state);
+        ForeachKmer(myreads, partitioners, batch_state, sampling);
 
         /*
          * ALLTOALL send counts: Number of k-mers my processor is sending to each other processor.
          */
-        std::transform(kmerbuckets.cbegin(), kmerbuckets.cend(), sendcnt.begin(), [](const auto& bucket) { return bucket.size() * TKmer::NBYTES; });
+        for (int i = 0; i < nprocs; ++i)
+        {
+            sendcnt[i] = 0;
+
+            for (const auto& kmerbuckets : threadbuckets)
+                sendcnt[i] += kmerbuckets[i].size() * TKmer::NBYTES;
+        }
 
         /*
          * ALLTOALL send displacements and total k-mers sending.
@@ -130,19 +240,24 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
         recvbuf.resize(totrecv, 0);
 
         /*
-         * Pack outgoing k-mers into send buffer.
+         * Pack outgoing k-mers into send buffer, straight from the buckets of
+         * each thread in thread order.
          */
+        #pragma omp parallel for schedule(dynamic)
         for (int i = 0; i < nprocs; ++i)
         {
             uint8_t *dest = sendbuf.data() + sdispls[i];
 
-            for (MPI_Count_type j = 0; j < kmerbuckets[i].size(); ++j)
+            for (auto& kmerbuckets : threadbuckets)
             {
-                memcpy(dest, kmerbuckets[i][j].GetBytes(), TKmer::NBYTES);
-                dest += TKmer::NBYTES;
-            }
+                for (const TKmer& kmer : kmerbuckets[i])
+                {
+                    memcpy(dest, kmer.GetBytes(), TKmer::NBYTES);
+                    dest += TKmer::NBYTES;
+                }
 
-            kmerbuckets[i].clear();
+                kmerbuckets[i].clear();
+            }
         }
 
         /*
@@ -151,40 +266,30 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
         MPI_ALLTOALLV(sendbuf.data(), sendcnt.data(), sdispls.data(), MPI_BYTE, recvbuf.data(), recvcnt.data(), rdispls.data(), MPI_BYTE, commgrid->GetWorld());
 
         /*
-         * Unpack incoming k-mers in a streaming fashion.
+         * Unpack incoming k-mers straight from the receive buffer.
          */
         numkmerseeds = totrecv / TKmer::NBYTES;
-        uint8_t *src = recvbuf.data();
-        for (size_t i = 0; i < numkmerseeds; ++i)
+        kmermap->countpacked(recvbuf.data(), numkmerseeds, [](const TKmer& mer)
         {
-            TKmer mer(src);
-            src += TKmer::NBYTES;
-
             /*
              * Check if incoming k-mer is already "inside" the local Bloom filter.
+             * If so, with high probability, the k-mer has already been
+             * inserted into the filter, and therefore is likely not a
+             * singleton k-mer. Count it in the local hash table partition,
+             * inserting it if it hasn't already been.
              */
             if (bm->Check(mer.GetBytes(), TKmer::NBYTES))
-            {
-                /*
-                 * With high probability, the k-mer has already been
-                 * inserted into the filter, and therefore is likely not a
-                 * singleton k-mer. Insert it into local hash table partition
-                 * if it hasn't already been.
-                 */
-                if (kmermap->find(mer) == kmermap->end())
-                    kmermap->insert({mer, KmerCountEntry({}, {}, 0)});
-            }
-            else
-            {
-                /*
-                 * k-mer definitely hasn't been seen before, therefore we
-                 * add it to the Bloom filter. If this k-mer is a singleton,
-                 * then we have effectively filtered it away from being
-                 * queried on the local hash table.
-                 */
-                bm->Add(mer.GetBytes(), TKmer::NBYTES);
-            }
-        }
+                return true;
+
+            /*
+             * k-mer definitely hasn't been seen before, therefore we
+             * add it to the Bloom filter. If this k-mer is a singleton,
+             * then we have effectively filtered it away from being
+             * queried on the local hash table.
+             */
+            bm->Add(mer.GetBytes(), TKmer::NBYTES);
+            return false;
+        });
 
         size_t justsent = (totsend / TKmer::NBYTES);
         size_t justrecv = (totrecv / TKmer::NBYTES);
@@ -194,42 +299,65 @@ get_kmer_count_map_keys(const DnaBuffer& myreads, std::shared_ptr<CommGrid> comm
 
         #if LOG_LEVEL >= 2
         logger() << " sent " << justsent << " k-mers parsed from " << (batch_state.myreadid - curid) << " reads and received " << justrecv << " k-mers";
+        log_round_memory(logger, get_bucket_bytes(threadbuckets), totsend, totrecv, *kmermap);
         rootlog << "Round " << batch_round++;
         logger.Flush(rootlog);
         #endif
 
     } while (!batch_state.Finished());
 
+    /*
+     * The first occurrence of every k-mer only went into the Bloom filter, so the
+     * counts are one short, except for the k-mers whose first occurrence was a Bloom
+     * filter false positive, which are one over once corrected. That is close enough
+     * to pick the bounds from. The k-mers that are certainly outside the frequency
+     * bounds are dropped right away, and the others get room for as many occurrences
+     * as they were counted.
+     */
+    kmermap->foreach([](KmerCountMap::Entry& entry) { entry.increment(); });
+    select_kmer_bounds(*kmermap, commgrid, total_totrecv, bounds);
+    kmermap->eraseif([&](const KmerCountMap::Entry& entry) { return entry.count < bounds.lower || entry.count > bounds.upper + 1; });
+    kmermap->allocateoccurrences();
+
+    #if LOG_LEVEL >= 2
+    logger() << kmermap->size() << " counted k-mers within the frequency bounds (" << std::setprecision(2) << std::fixed << (kmermap->gettablesize() / (1024.0 * 1024.0)) << " MB table, "
+             << (kmermap->getoccurrencesize() / (1024.0 * 1024.0)) << " MB occurrences)";
+    logger.Flush("K-mer counting:");
+    #endif
+
     return std::unique_ptr<KmerCountMap>(kmermap);
 }
 
-void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid)
+/*
+ * A k-mer seed is sent as its k-mer, read id, and position, packed one after another.
+ */
+constexpr size_t seedbytes = TKmer::NBYTES + sizeof(ReadId) + sizeof(PosInRead);
+
+static ReadId getseedreadid(const uint8_t *seed) { return *((ReadId*)(seed + TKmer::NBYTES)); }
+static PosInRead getseedpos(const uint8_t *seed) { return *((PosInRead*)(seed + TKmer::NBYTES + sizeof(ReadId))); }
+
+/*
+ * Sends the k-mer seeds in the per-thread buckets @threadseeds to their owners, and
+ * returns the (packed) k-mer seeds I own, in order of source processor. Empties @threadseeds.
+ */
+static std::vector<uint8_t> exchange_kmer_seeds(std::vector<std::vector<std::vector<KmerSeed>>>& threadseeds, std::shared_ptr<CommGrid> commgrid)
 {
     Logger logger(commgrid);
-    int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
-    size_t numreads = myreads.size();
-    std::vector<std::vector<KmerSeed>> kmerseeds(nprocs);
-    size_t readoffset = numreads;
-
-    MPI_Exscan(&numreads, &readoffset, 1, MPI_SIZE_T, MPI_SUM, commgrid->GetWorld());
-    if (!myrank) readoffset = 0;
-
-    KmerParserHandler parser(kmerseeds, static_cast<ReadId>(readoffset));
-    ForeachKmer(myreads, parser);
 
     std::vector<MPI_Count_type> sendcnt(nprocs), recvcnt(nprocs);
     std::vector<MPI_Displ_type> sdispls(nprocs), rdispls(nprocs);
 
-    constexpr size_t seedbytes = TKmer::NBYTES + sizeof(ReadId) + sizeof(PosInRead);
-
     #if LOG_LEVEL >= 2
     logger() << std::setprecision(4) << "sending 'row' k-mers to each processor in this amount (megabytes): {";
     #endif
 
     for (int i = 0; i < nprocs; ++i)
     {
-        sendcnt[i] = kmerseeds[i].size() * seedbytes;
+        sendcnt[i] = 0;
+
+        for (const auto& kmerseeds : threadseeds)
+            sendcnt[i] += kmerseeds[i].size() * seedbytes;
 
         #if LOG_LEVEL >= 2
         logger() << (static_cast<double>(sendcnt[i]) / (1024 * 1024)) << ",";
@@ -247,75 +375,141 @@ void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap,
     std::partial_sum(sendcnt.begin(), sendcnt.end()-1, sdispls.begin()+1);
     std::partial_sum(recvcnt.begin(), recvcnt.end()-1, rdispls.begin()+1);
 
-    size_t totsend = std::accumulate(sendcnt.begin(), sendcnt.end(), 0);
-    size_t totrecv = std::accumulate(recvcnt.begin(), recvcnt.end(), 0);
+    size_t totsend = sdispls.back() + sendcnt.back();
+    size_t totrecv = rdispls.back() + recvcnt.back();
 
     std::vector<uint8_t> sendbuf(totsend, 0);
 
+    #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < nprocs; ++i)
     {
-        assert(kmerseeds[i].size() == (sendcnt[i] / seedbytes));
         uint8_t *addrs2fill = sendbuf.data() + sdispls[i];
-        for (MPI_Count_type j = 0; j < kmerseeds[i].size(); ++j)
+        for (auto& kmerseeds : threadseeds)
         {
-            auto& seeditr = kmerseeds[i][j];
-            TKmer kmer = std::get<0>(seeditr);
-            ReadId readid = std::get<1>(seeditr);
-            PosInRead pos = std::get<2>(seeditr);
-            memcpy(addrs2fill, kmer.GetBytes(), TKmer::NBYTES);
-            memcpy(addrs2fill + TKmer::NBYTES, &readid, sizeof(ReadId));
-            memcpy(addrs2fill + TKmer::NBYTES + sizeof(ReadId), &pos, sizeof(PosInRead));
-            addrs2fill += seedbytes;
+            for (const KmerSeed& seed : kmerseeds[i])
+            {
+                TKmer kmer = std::get<0>(seed);
+                ReadId readid = std::get<1>(seed);
+                PosInRead pos = std::get<2>(seed);
+                memcpy(addrs2fill, kmer.GetBytes(), TKmer::NBYTES);
+                memcpy(addrs2fill + TKmer::NBYTES, &readid, sizeof(ReadId));
+                memcpy(addrs2fill + TKmer::NBYTES + sizeof(ReadId), &pos, sizeof(PosInRead));
+                addrs2fill += seedbytes;
+            }
+            kmerseeds[i].clear();
         }
-        kmerseeds[i].clear();
+        assert(addrs2fill == sendbuf.data() + sdispls[i] + sendcnt[i]);
     }
 
     std::vector<uint8_t> recvbuf(totrecv, 0);
     MPI_ALLTOALLV(sendbuf.data(), sendcnt.data(), sdispls.data(), MPI_BYTE, recvbuf.data(), recvcnt.data(), rdispls.data(), MPI_BYTE, commgrid->GetWorld());
 
-    size_t numkmerseeds = totrecv / seedbytes;
+    return recvbuf;
+}
+
+/*
+ * Global id of my first read, the reads being numbered in processor order.
+ */
+static ReadId get_read_offset(size_t numreads, std::shared_ptr<CommGrid> commgrid)
+{
+    size_t readoffset = numreads;
+
+    MPI_Exscan(&numreads, &readoffset, 1, MPI_SIZE_T, MPI_SUM, commgrid->GetWorld());
+    if (!commgrid->GetRank()) readoffset = 0;
+
+    return static_cast<ReadId>(readoffset);
+}
+
+/*
+ * Drops the k-mers seen less than @lower times from @kmermap, and
+ * reports how many reliable k-mers all processors are left with.
+ */
+static void erase_unreliable_kmers(KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, int lower)
+{
+    kmermap.eraseif([&](const KmerCountMap::Entry& entry) { return entry.count < lower; });
 
     #if LOG_LEVEL >= 2
-    logger() << "received a total of " << numkmerseeds << " 'row' k-mers in second ALLTOALL exchange";
-    logger.Flush("K-mers received:");
+    size_t numkmers = kmermap.size();
+
+    MPI_Allreduce(MPI_IN_PLACE, &numkmers, 1, MPI_SIZE_T, MPI_SUM, commgrid->GetWorld());
+
+    if (!commgrid->GetRank()) std::cout << "A total of " << numkmers << " reliable 'column' k-mers found\n" << std::endl;
+    MPI_Barrier(commgrid->GetWorld());
     #endif
+}
 
-    uint8_t *addrs2read = recvbuf.data();
+void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid, const KmerBounds& bounds, const HpcBuffer *hpcreads, const KmerSampling& sampling, size_t batchmem)
+{
+    Logger logger(commgrid);
+    std::ostringstream rootlog;
+    int nprocs = commgrid->GetSize();
+    int nthreads = omp_get_max_threads();
+    size_t numreads = myreads.size();
+    std::vector<std::vector<std::vector<KmerSeed>>> threadseeds(nthreads, std::vector<std::vector<KmerSeed>>(nprocs));
+    std::vector<KmerParserHandler> parsers;
+    ReadId readoffset = get_read_offset(numreads, commgrid);
+    size_t numkmerseeds = 0;
+
+    for (auto& kmerseeds : threadseeds)
+        parsers.emplace_back(kmerseeds, readoffset);
+
+    /*
+     * Same batching as the first pass: only the k-mer seeds of one batch of reads,
+     * and a single packed copy of them, are ever held in memory at a time.
+     */
+    BatchState batch_state(numreads, commgrid, seedbytes, batchmem);
+    int batch_round = 1;
 
-    for (size_t i = 0; i < numkmerseeds; ++i)
+    do
     {
-        TKmer kmer(addrs2read);
+        ReadId curid = batch_state.myreadid;
 
-        #if USE_BLOOM == 1
-        if (!bm->Check(kmer.GetBytes(), TKmer::NBYTES))
-            continue;
+        if (hpcreads) ForeachKmer(*hpcreads, parsers, batch_state, sampling);
+        else ForeachKmer(myreads, parsers, batch_state, sampling);
 
-        #else
-        static_assert(USE_BLOOM == 0);
-        #endif
+        std::vector<uint8_t> recvbuf = exchange_kmer_seeds(threadseeds, commgrid);
+        size_t numrecv = recvbuf.size() / seedbytes;
+        uint8_t *addrs2read = recvbuf.data();
 
-        ReadId readid = *((ReadId*)(addrs2read + TKmer::NBYTES));
-        PosInRead pos = *((PosInRead*)(addrs2read + TKmer::NBYTES + sizeof(ReadId)));
-        addrs2read += seedbytes;
+        for (size_t i = 0; i < numrecv; ++i)
+        {
+            TKmer kmer(addrs2read);
 
-        auto kmitr = kmermap.find(kmer);
-        if (kmitr == kmermap.end()) continue;
-        KmerCountEntry& entry = kmitr->second;
+            #if USE_BLOOM == 1
+            if (!bm->Check(kmer.GetBytes(), TKmer::NBYTES))
+            {
+                addrs2read += seedbytes;
+                continue;
+            }
 
-        READIDS& readids      = std::get<0>(entry);
-        POSITIONS& positions  = std::get<1>(entry);
-        int& count            = std::get<2>(entry);
+            #else
+            static_assert(USE_BLOOM == 0);
+            #endif
 
-        if (count >= UPPER_KMER_FREQ)
-        {
-            kmermap.erase(kmer);
-            continue;
+            ReadId readid = getseedreadid(addrs2read);
+            PosInRead pos = getseedpos(addrs2read);
+            addrs2read += seedbytes;
+
+            KmerCountMap::Entry *entry = kmermap.find(kmer);
+            if (entry) kmermap.addoccurrence(*entry, readid, pos);
         }
 
-        readids[count] = readid;
-        positions[count] = pos;
-        count++;
-    }
+        numkmerseeds += numrecv;
+
+        #if LOG_LEVEL >= 2
+        logger() << " sent " << batch_state.mykmerssofar << " 'row' k-mers parsed from " << (batch_state.myreadid - curid) << " reads and received " << numrecv << " 'row' k-mers";
+        log_round_memory(logger, get_bucket_bytes(threadseeds), batch_state.mykmerssofar * seedbytes, recvbuf.size(), kmermap);
+        rootlog << "Round " << batch_round++;
+        logger.Flush(rootlog);
+        #endif
+
+    } while (!batch_state.Finished());
+
+    /*
+     * The counts of the first pass were exact but for Bloom filter false positives,
+     * so a k-mer may turn out to have one occurrence too many.
+     */
+    kmermap.eraseif([&](const KmerCountMap::Entry& entry) { return entry.count > bounds.upper; });
 
     #if LOG_LEVEL >= 2
     logger() << numkmerseeds;
@@ -329,24 +523,201 @@ void get_kmer_count_map_values(const DnaBuffer& myreads, KmerCountMap& kmermap,
     logger() << " row k-mers filtered by hash table and upper k-mer bound threshold into " << kmermap.size() << " semi-reliable 'column' k-mers";
     #endif
 
+    logger() << " (" << std::setprecision(2) << std::fixed << (kmermap.gettablesize() / (1024.0 * 1024.0)) << " MB table, " << (kmermap.getoccurrencesize() / (1024.0 * 1024.0)) << " MB occurrences)";
     logger.Flush("K-mer filtering:");
     #endif
 
-    auto itr = kmermap.begin();
-    while (itr != kmermap.end())
+    erase_unreliable_kmers(kmermap, commgrid, bounds.lower);
+}
+
+/*
+ * Append-only list of packed k-mer seeds that keeps at most @maxbytes of them in
+ * memory: whenever that fills up, they are moved to an anonymous temporary file.
+ */
+class SeedSpill
+{
+public:
+    SeedSpill(size_t maxbytes) : maxbytes(std::max(maxbytes / seedbytes, static_cast<size_t>(1)) * seedbytes), file(nullptr), spilledbytes(0) {}
+    ~SeedSpill() { if (file) std::fclose(file); }
+
+    void append(const uint8_t *seed)
     {
-        if (std::get<2>(itr->second) < LOWER_KMER_FREQ) itr = kmermap.erase(itr);
-        else itr++;
+        seeds.insert(seeds.end(), seed, seed + seedbytes);
+
+        if (seeds.size() >= maxbytes)
+            spill();
     }
 
-    #if LOG_LEVEL >= 2
-    size_t numkmers = kmermap.size();
+    size_t size() const { return (spilledbytes + seeds.size()) / seedbytes; }
+    size_t getspilledbytes() const { return spilledbytes; }
 
-    MPI_Allreduce(MPI_IN_PLACE, &numkmers, 1, MPI_SIZE_T, MPI_SUM, commgrid->GetWorld());
+    /*
+     * Calls @f(seed) for every seed, in the order they were appended.
+     */
+    template <typename F>
+    void foreach(F&& f)
+    {
+        std::vector<uint8_t> chunk;
 
-    if (!myrank) std::cout << "A total of " << numkmers << " reliable 'column' k-mers found\n" << std::endl;
-    MPI_Barrier(commgrid->GetWorld());
+        if (file) std::rewind(file);
+
+        for (size_t done = 0; done < spilledbytes; done += chunk.size())
+        {
+            chunk.resize(std::min(maxbytes, spilledbytes - done));
+
+            if (std::fread(chunk.data(), 1, chunk.size(), file) != chunk.size())
+                failed("read");
+
+            for (size_t i = 0; i < chunk.size(); i += seedbytes)
+                f(chunk.data() + i);
+        }
+
+        for (size_t i = 0; i < seeds.size(); i += seedbytes)
+            f(seeds.data() + i);
+    }
+
+private:
+    size_t maxbytes;
+    std::FILE *file;
+    size_t spilledbytes;
+    std::vector<uint8_t> seeds;
+
+    void spill()
+    {
+        if (!file && !(file = std::tmpfile()))
+            failed("create");
+
+        if (std::fwrite(seeds.data(), 1, seeds.size(), file) != seeds.size())
+            failed("write");
+
+        spilledbytes += seeds.size();
+        seeds.clear();
+    }
+
+    static void failed(char const *what)
+    {
+        std::cerr << "error: could not " << what << " temporary k-mer seed file" << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+};
+
+std::unique_ptr<KmerCountMap>
+get_kmer_count_map_fused(const DnaBuffer& myreads, std::shared_ptr<CommGrid> commgrid, KmerBounds& bounds, const HpcBuffer *hpcreads, const KmerSampling& sampling, size_t batchmem)
+{
+    int nprocs = commgrid->GetSize();
+    int nthreads = omp_get_max_threads();
+    size_t numreads = myreads.size();
+
+    auto kmermap = std::make_unique<KmerCountMap>();                            /* K-mers seen more than once, counted and then with their occurrences */
+    SeedSpill firstseeds(MAX_SEED_SPILL_MEM);                                   /* First occurrences of the k-mers, as far as the Bloom filter can tell */
+    SeedSpill laterseeds(MAX_SEED_SPILL_MEM);                                   /* Other occurrences of the k-mers not yet seen too often */
+    std::vector<std::vector<std::vector<KmerSeed>>> threadseeds(nthreads, std::vector<std::vector<KmerSeed>>(nprocs));
+    std::vector<KmerParserHandler> parsers;
+    size_t numkmerseeds = 0;
+    Logger logger(commgrid);
+    std::ostringstream rootlog;
+
+    double cardinality = estimate_kmer_cardinality(hpcreads? hpcreads->getdna() : myreads, commgrid, sampling);
+
+    kmermap->reserve(static_cast<size_t>(std::ceil(cardinality / nprocs)));
+    bm = new Bloom(static_cast<int64_t>(std::ceil(cardinality)), 0.05);
+
+    ReadId readoffset = get_read_offset(numreads, commgrid);
+
+    for (auto& kmerseeds : threadseeds)
+        parsers.emplace_back(kmerseeds, readoffset);
+
+    BatchState batch_state(numreads, commgrid, seedbytes, batchmem);
+    int batch_round = 1;
+
+    do
+    {
+        ReadId curid = batch_state.myreadid;
+
+        if (hpcreads) ForeachKmer(*hpcreads, parsers, batch_state, sampling);
+        else ForeachKmer(myreads, parsers, batch_state, sampling);
+
+        std::vector<uint8_t> recvbuf = exchange_kmer_seeds(threadseeds, commgrid);
+        size_t numrecv = recvbuf.size() / seedbytes;
+
+        for (size_t i = 0; i < numrecv; ++i)
+        {
+            const uint8_t *seed = recvbuf.data() + i * seedbytes;
+            TKmer kmer(seed);
+
+            /*
+             * A k-mer that is not in the Bloom filter yet is seen for the first time,
+             * and is most likely a singleton. It is kept aside instead of going into
+             * the hash table, until we know which k-mers were seen again.
+             */
+            if (!bm->Check(kmer.GetBytes(), TKmer::NBYTES))
+            {
+                bm->Add(kmer.GetBytes(), TKmer::NBYTES);
+                firstseeds.append(seed);
+                continue;
+            }
+
+            /*
+             * The occurrences of a k-mer seen more often than
+             * the upper bound are no longer worth keeping.
+             */
+            KmerCountMap::Entry& entry = kmermap->insert(kmer);
+
+            if (entry.increment() <= bounds.upper)
+                laterseeds.append(seed);
+        }
+
+        numkmerseeds += numrecv;
+
+        #if LOG_LEVEL >= 2
+        logger() << " sent " << batch_state.mykmerssofar << " k-mer seeds parsed from " << (batch_state.myreadid - curid) << " reads and received " << numrecv << " k-mer seeds";
+        log_round_memory(logger, get_bucket_bytes(threadseeds), batch_state.mykmerssofar * seedbytes, recvbuf.size(), *kmermap);
+        rootlog << "Round " << batch_round++;
+        logger.Flush(rootlog);
+        #endif
+
+    } while (!batch_state.Finished());
+
+    delete bm;
+
+    /*
+     * Count the first occurrences too, which makes the counts exact. Singletons
+     * never enter the map, just as the Bloom filter keeps them out of the
+     * two-pass counter, so both modes seed with the same k-mers even at -l 1.
+     */
+    firstseeds.foreach([&](const uint8_t *seed)
+    {
+        KmerCountMap::Entry *entry = kmermap->find(TKmer(seed));
+        if (entry) entry->increment();
+    });
+
+    select_kmer_bounds(*kmermap, commgrid, numkmerseeds, bounds);
+    kmermap->eraseif([&](const KmerCountMap::Entry& entry) { return entry.count < bounds.lower || entry.count > bounds.upper; });
+    kmermap->allocateoccurrences();
+
+    /*
+     * The first occurrence of a k-mer arrived before all the others, so it
+     * goes first. The occurrences of the k-mers just erased find no entry.
+     */
+    auto record = [&](const uint8_t *seed)
+    {
+        KmerCountMap::Entry *entry = kmermap->find(TKmer(seed));
+        if (entry) kmermap->addoccurrence(*entry, getseedreadid(seed), getseedpos(seed));
+    };
+
+    firstseeds.foreach(record);
+    laterseeds.foreach(record);
+
+    #if LOG_LEVEL >= 2
+    logger() << numkmerseeds << " row k-mers (" << firstseeds.size() << " first occurrences, " << std::setprecision(2) << std::fixed << ((firstseeds.getspilledbytes() + laterseeds.getspilledbytes()) / (1024.0 * 1024.0)) << " MB of k-mer seeds spilled to disk)";
+    logger() << " filtered by Bloom filter and k-mer bounds into " << kmermap->size() << " reliable 'column' k-mers";
+    logger() << " (" << (kmermap->gettablesize() / (1024.0 * 1024.0)) << " MB table, " << (kmermap->getoccurrencesize() / (1024.0 * 1024.0)) << " MB occurrences)";
+    logger.Flush("K-mer filtering:");
     #endif
+
+    erase_unreliable_kmers(*kmermap, commgrid, bounds.lower);
+
+    return kmermap;
 }
 
 int GetKmerOwner(const TKmer& kmer, int nprocs)
@@ -359,17 +730,16 @@ int GetKmerOwner(const TKmer& kmer, int nprocs)
 }
 
 std::unique_ptr<CT<PosInRead>::PSpParMat>
-create_kmer_matrix(const DnaBuffer& myreads, const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid)
+create_kmer_matrix(const KmerCountMap& kmermap, const DistributedFastaData& dfd, std::shared_ptr<CommGrid> commgrid)
 {
     int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
 
     int64_t kmerid = kmermap.size();
     int64_t totkmers = kmerid;
-    int64_t totreads = myreads.size();
+    int64_t matrixdim = dfd.getmatrixdim();
 
     MPI_Allreduce(&kmerid,      &totkmers, 1, MPI_INT64_T, MPI_SUM, commgrid->GetWorld());
-    MPI_Allreduce(MPI_IN_PLACE, &totreads, 1, MPI_INT64_T, MPI_SUM, commgrid->GetWorld());
 
     MPI_Exscan(MPI_IN_PLACE, &kmerid, 1, MPI_INT64_T, MPI_SUM, commgrid->GetWorld());
     if (myrank == 0) kmerid = 0;
@@ -377,25 +747,21 @@ create_kmer_matrix(const DnaBuffer& myreads, const KmerCountMap& kmermap, std::s
     std::vector<int64_t> local_rowids, local_colids;
     std::vector<PosInRead> local_positions;
 
-    for (auto itr = kmermap.cbegin(); itr != kmermap.cend(); ++itr)
+    kmermap.foreach([&](const KmerCountMap::Entry& entry)
     {
-        const READIDS& readids = std::get<0>(itr->second);
-        const POSITIONS& positions = std::get<1>(itr->second);
-        int cnt = std::get<2>(itr->second);
-
-        for (int j = 0; j < cnt; ++j)
+        kmermap.foreachoccurrence(entry, [&](ReadId readid, PosInRead pos)
         {
             local_colids.push_back(kmerid);
-            local_rowids.push_back(readids[j]);
-            local_positions.push_back(positions[j]);
-        }
+            local_rowids.push_back(dfd.getmatrixid(readid));
+            local_positions.push_back(pos);
+        });
 
         kmerid++;
-    }
+    });
 
     CT<int64_t>::PDistVec drows(local_rowids, commgrid);
     CT<int64_t>::PDistVec dcols(local_colids, commgrid);
     CT<PosInRead>::PDistVec dvals(local_positions, commgrid);
 
-    return std::make_unique<CT<PosInRead>::PSpParMat>(totreads, totkmers, drows, dcols, dvals, false);
+    return std::make_unique<CT<PosInRead>::PSpParMat>(matrixdim, totkmers, drows, dcols, dvals, false);
 }
@@ -0,0 +1,124 @@
+#include "MemoryBudget.hpp"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+/*
+ * Value of field @key in /proc file @fname, whose lines look like "key:   1234 kB",
+ * in bytes. Zero if there is no such file or field.
+ */
+static size_t readprocfield(char const *fname, char const *key)
+{
+    std::ifstream in(fname);
+    std::string line;
+    size_t keylen = std::strlen(key);
+
+    while (std::getline(in, line))
+        if (line.compare(0, keylen, key) == 0 && line.size() > keylen && line[keylen] == ':')
+            return std::stoull(line.substr(keylen+1)) * 1024;
+
+    return 0;
+}
+
+/*
+ * Resets VmHWM to the current VmRSS (Linux 4.0 and later).
+ */
+static bool resetpeak()
+{
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5" << std::flush;
+    return out.good();
+}
+
+size_t MemoryBudget::getresident() { return readprocfield("/proc/self/status", "VmRSS"); }
+size_t MemoryBudget::getpeak() { return readprocfield("/proc/self/status", "VmHWM"); }
+
+MemoryBudget::MemoryBudget(MPI_Comm comm, size_t nodecapmb) : comm(comm), phasebudget(0)
+{
+    int myrank, myranksonnode;
+    MPI_Comm nodecomm;
+
+    MPI_Comm_rank(comm, &myrank);
+    isroot = (myrank == 0);
+
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myrank, MPI_INFO_NULL, &nodecomm);
+    MPI_Comm_size(nodecomm, &myranksonnode);
+    MPI_Comm_free(&nodecomm);
+
+    unsigned long long myavailable = readprocfield("/proc/meminfo", "MemAvailable");
+    unsigned long long nodecap = static_cast<unsigned long long>(nodecapmb) * 1024 * 1024;
+
+    if (nodecap && (!myavailable || nodecap < myavailable))
+        myavailable = nodecap;
+
+    /*
+     * If some process can't tell how much memory its node has, its share is 0 and
+     * so is everyone's budget, which means no budget at all.
+     */
+    unsigned long long myshare = myavailable / myranksonnode, share, available;
+
+    MPI_Allreduce(&myshare, &share, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, comm);
+    MPI_Allreduce(&myavailable, &available, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, comm);
+    MPI_Allreduce(&myranksonnode, &ranksonnode, 1, MPI_INT, MPI_MAX, comm);
+
+    budget = share;
+    nodeavailable = available;
+
+    int mycanreset = resetpeak(), allcanreset;
+    MPI_Allreduce(&mycanreset, &allcanreset, 1, MPI_INT, MPI_LAND, comm);
+    canresetpeak = allcanreset;
+}
+
+void MemoryBudget::start()
+{
+    if (canresetpeak) resetpeak();
+    phasebudget = 0;
+}
+
+void MemoryBudget::start_with_budget()
+{
+    start();
+
+    /*
+     * What the process already holds (reads, matrices from the previous phase) is
+     * not the phase's to use. A process that is already over budget still gets a
+     * small share, so that phases which size their buffers from it keep going.
+     */
+    size_t resident = getresident();
+    unsigned long long myphasebudget = std::max(budget > resident? budget - resident : 0, budget / 16), minphasebudget;
+
+    MPI_Allreduce(&myphasebudget, &minphasebudget, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, comm);
+    phasebudget = minphasebudget;
+}
+
+void MemoryBudget::stop_and_log(char const *label)
+{
+    unsigned long long mypeak = getpeak(), maxpeak, totpeak;
+    int nprocs;
+
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Reduce(&mypeak, &maxpeak, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, comm);
+    MPI_Reduce(&mypeak, &totpeak, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, comm);
+
+    if (isroot)
+    {
+        constexpr double mb = 1024.0 * 1024.0;
+        char const *since = canresetpeak? "" : " since start";
+
+        std::cout << label << " (memory):\n";
+        std::cout << "    peak resident memory" << since << " (max process MB): " << std::fixed << std::setprecision(1) << (maxpeak / mb) << "\n";
+        std::cout << "    peak resident memory" << since << " (avg process MB): " << std::fixed << std::setprecision(1) << (totpeak / mb / nprocs) << "\n";
+
+        if (phasebudget)
+            std::cout << "    phase budget (per process MB): " << std::fixed << std::setprecision(1) << (phasebudget / mb) << (maxpeak > budget? " [total budget exceeded]" : "") << "\n";
+        else if (budget && maxpeak > budget)
+            std::cout << "    total budget (per process MB): " << std::fixed << std::setprecision(1) << (budget / mb) << " [exceeded]\n";
+
+        std::cout << std::endl;
+    }
+
+    MPI_Barrier(comm);
+}
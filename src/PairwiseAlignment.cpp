@@ -3,7 +3,7 @@
 #include "Logger.hpp"
 
 std::unique_ptr<CT<Overlap>::PSpParMat>
-PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, int mat, int mis, int gap, int dropoff)
+PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, int mat, int mis, int gap, int dropoff, bool hpcseeds)
 {
     FastaIndex& index = dfd.getindex();
     auto commgrid = index.getcommgrid();
@@ -18,8 +18,8 @@ PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, i
     alignseeds.reserve(localnnzs);
     auto dcsc = Bmat.seqptr()->GetDCSC();
 
-    int64_t rowoffset = dfd.getrowstartid();
-    int64_t coloffset = dfd.getcolstartid();
+    int64_t rowoffset = dfd.getrowmatrixstartid();
+    int64_t coloffset = dfd.getcolmatrixstartid();
 
     /*
      * Go through each local k-mer seed.
@@ -88,7 +88,7 @@ PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, i
 
         /* TODO: change the below two lines */
         overlaps.emplace_back(len, std::get<2>(alignseeds[i])->getseeds()[0]);
-        overlaps.back().extend_overlap(seqQ, seqT, mat, mis, gap, dropoff);
+        overlaps.back().extend_overlap(seqQ, seqT, mat, mis, gap, dropoff, hpcseeds);
 
         local_rowids.push_back(localrow + rowoffset);
         local_colids.push_back(localcol + coloffset);
@@ -98,9 +98,9 @@ PairwiseAlignment(DistributedFastaData& dfd, CT<SharedSeeds>::PSpParMat& Bmat, i
     CT<int64_t>::PDistVec dcols(local_colids, commgrid);
     CT<Overlap>::PDistVec dvals(overlaps, commgrid);
 
-    int64_t numreads = index.gettotrecords();
+    int64_t matrixdim = dfd.getmatrixdim();
 
-    auto R = std::make_unique<CT<Overlap>::PSpParMat>(numreads, numreads, drows, dcols, dvals, false);
+    auto R = std::make_unique<CT<Overlap>::PSpParMat>(matrixdim, matrixdim, drows, dcols, dvals, false);
 
     return std::move(R);
 }
@@ -122,17 +122,17 @@ std::vector<PileupVector> GetReadPileup(DistributedFastaData& dfd, CT<Overlap>::
      * nonzero in that locally stored column */
     std::vector<PileupVector> local_pileups;
     size_t local_ncols = spSeq.getncol();
-    assert(local_ncols == dfd.getnumcolreads());
+    size_t numcolreads = dfd.getnumcolreads();
+    assert(local_ncols == dfd.getdimsize() && numcolreads <= local_ncols);
     local_pileups.reserve(local_ncols);
 
+    /* the local columns past my grid column's reads are empty (see DistributedFastaData) */
     for (size_t i = 0; i < local_ncols; ++i)
     {
-        int read_length = (*colbuf)[i].size();
+        int read_length = i < numcolreads? (*colbuf)[i].size() : 0;
         local_pileups.emplace_back(read_length);
     }
 
-    size_t col_offset = dfd.getcolstartid();
-
     /* iterate over every local column */
     for (auto colit = spSeq.begcol(); colit != spSeq.endcol(); ++colit)
     {
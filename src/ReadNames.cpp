@@ -0,0 +1,118 @@
+#include "ReadNames.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+void ReadNames::fetch(std::vector<size_t> readids)
+{
+    std::shared_ptr<CommGrid> commgrid = index.getcommgrid();
+    int nprocs = commgrid->GetSize();
+    MPI_Comm comm = commgrid->GetWorld();
+
+    /*
+     * Only ask for the names that aren't cached yet. Sorted by id, the
+     * names I need from each owner are contiguous.
+     */
+    std::sort(readids.begin(), readids.end());
+    readids.erase(std::unique(readids.begin(), readids.end()), readids.end());
+
+    std::vector<size_t> newids;
+    std::set_difference(readids.begin(), readids.end(), cachedids.begin(), cachedids.end(), std::back_inserter(newids));
+
+    std::vector<MPI_Count_type> sendcounts(nprocs, 0), recvcounts(nprocs);
+    std::vector<MPI_Displ_type> senddispls(nprocs), recvdispls(nprocs);
+
+    for (size_t id : newids)
+        sendcounts[index.getreadowner(id)]++;
+
+    MPI_ALLTOALL(sendcounts.data(), 1, MPI_COUNT_TYPE, recvcounts.data(), 1, MPI_COUNT_TYPE, comm);
+
+    std::exclusive_scan(sendcounts.begin(), sendcounts.end(), senddispls.begin(), static_cast<MPI_Displ_type>(0));
+    std::exclusive_scan(recvcounts.begin(), recvcounts.end(), recvdispls.begin(), static_cast<MPI_Displ_type>(0));
+
+    size_t numrequested = recvdispls.back() + recvcounts.back();
+    std::vector<size_t> requestedids(numrequested);
+
+    MPI_ALLTOALLV(newids.data(), sendcounts.data(), senddispls.data(), MPI_SIZE_T, requestedids.data(), recvcounts.data(), recvdispls.data(), MPI_SIZE_T, comm);
+
+    /*
+     * Answer the requests for the names of my reads, in the order they were
+     * asked for: first the name lengths, then the names themselves.
+     */
+    const auto& mynames = index.getmynames();
+    size_t myreaddispl = index.getmyreaddispl();
+
+    std::vector<size_t> replylens(numrequested), newlens(newids.size());
+    std::vector<MPI_Count_type> replycharcounts(nprocs, 0), newcharcounts(nprocs);
+    std::vector<MPI_Displ_type> replychardispls(nprocs), newchardispls(nprocs);
+    std::vector<char> replybuf;
+
+    for (int i = 0; i < nprocs; ++i)
+        for (MPI_Displ_type j = recvdispls[i]; j < recvdispls[i] + recvcounts[i]; ++j)
+        {
+            const std::string& name = mynames[requestedids[j] - myreaddispl];
+            replylens[j] = name.size();
+            replybuf.insert(replybuf.end(), name.begin(), name.end());
+            replycharcounts[i] += name.size();
+        }
+
+    MPI_ALLTOALLV(replylens.data(), recvcounts.data(), recvdispls.data(), MPI_SIZE_T, newlens.data(), sendcounts.data(), senddispls.data(), MPI_SIZE_T, comm);
+    MPI_ALLTOALL(replycharcounts.data(), 1, MPI_COUNT_TYPE, newcharcounts.data(), 1, MPI_COUNT_TYPE, comm);
+
+    std::exclusive_scan(replycharcounts.begin(), replycharcounts.end(), replychardispls.begin(), static_cast<MPI_Displ_type>(0));
+    std::exclusive_scan(newcharcounts.begin(), newcharcounts.end(), newchardispls.begin(), static_cast<MPI_Displ_type>(0));
+
+    std::vector<char> newbuf(newchardispls.back() + newcharcounts.back());
+    MPI_ALLTOALLV(replybuf.data(), replycharcounts.data(), replychardispls.data(), MPI_CHAR, newbuf.data(), newcharcounts.data(), newchardispls.data(), MPI_CHAR, comm);
+
+    /*
+     * Merge the fetched names into the cache, keeping it sorted by id.
+     */
+    std::vector<size_t> mergedids, mergedoffsets(1, 0);
+    std::vector<char> mergedbuf;
+
+    mergedids.reserve(cachedids.size() + newids.size());
+    mergedoffsets.reserve(cachedids.size() + newids.size() + 1);
+    mergedbuf.reserve(namebuf.size() + newbuf.size());
+
+    size_t i = 0, j = 0, newhead = 0;
+
+    while (i < cachedids.size() || j < newids.size())
+    {
+        if (j == newids.size() || (i < cachedids.size() && cachedids[i] < newids[j]))
+        {
+            mergedids.push_back(cachedids[i]);
+            mergedbuf.insert(mergedbuf.end(), namebuf.begin() + nameoffsets[i], namebuf.begin() + nameoffsets[i+1]);
+            ++i;
+        }
+        else
+        {
+            mergedids.push_back(newids[j]);
+            mergedbuf.insert(mergedbuf.end(), newbuf.begin() + newhead, newbuf.begin() + newhead + newlens[j]);
+            newhead += newlens[j];
+            ++j;
+        }
+
+        mergedoffsets.push_back(mergedbuf.size());
+    }
+
+    cachedids.swap(mergedids);
+    nameoffsets.swap(mergedoffsets);
+    namebuf.swap(mergedbuf);
+
+    #if LOG_LEVEL >= 2
+    Logger logger(commgrid);
+    logger() << "fetched " << newids.size() << " names (" << newbuf.size() << " bytes), served " << numrequested << " names, " << cachedids.size() << " names cached (" << namebuf.size() << " bytes)";
+    logger.Flush("Read name fetching:");
+    #endif
+}
+
+std::string_view ReadNames::operator[](size_t readid) const
+{
+    auto itr = std::lower_bound(cachedids.begin(), cachedids.end(), readid);
+    assert(itr != cachedids.end() && *itr == readid);
+
+    size_t i = itr - cachedids.begin();
+    return std::string_view(namebuf.data() + nameoffsets[i], nameoffsets[i+1] - nameoffsets[i]);
+}
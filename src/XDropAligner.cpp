@@ -43,6 +43,51 @@ void classify_alignment(const XSeed& ai, int lenQ, int lenT, OverlapClass& kind)
     }
 }
 
+/*
+ * Nucleotide codes of a sequence read outward from one end of a seed. Rather
+ * than calling DnaSeq::operator[] for every cell of every anti-diagonal, the
+ * codes are unpacked 32 at a time with DnaSeq::getword (reading forwards) or
+ * DnaSeq::getrcword (reading backwards) the first time the extension reaches
+ * them. The k-th code is seq[start+k] (seq[start-k] if @reverse), complemented
+ * if @complement, for k < @count.
+ */
+class OutwardCodes
+{
+public:
+    OutwardCodes(const DnaSeq& seq, int start, int count, bool reverse, bool complement)
+        : seq(seq), start(start), count(count), reverse(reverse), complement(complement) {}
+
+    int operator[](int k)
+    {
+        while (k >= static_cast<int>(codes.size())) unpack();
+        return codes[k];
+    }
+
+private:
+    const DnaSeq& seq;
+    int start, count;
+    bool reverse, complement;
+    std::vector<uint8_t> codes;
+
+    void unpack()
+    {
+        int k = codes.size();
+        int n = std::min(count - k, 32);
+
+        assert(n > 0);
+
+        /*
+         * getrcword(len-1-(start-k)) packs the complements of seq[start-k],
+         * seq[start-k-1], ... so reading backwards comes complemented for free.
+         */
+        uint64_t word = reverse? seq.getrcword(seq.size() - 1 - (start - k)) : seq.getword(start + k);
+        if (reverse != complement) word = ~word;
+
+        for (int j = 0; j < n; ++j)
+            codes.push_back((word >> (62 - 2*j)) & 3);
+    }
+};
+
 int _extend_seed_one_direction(const DnaSeq& seqQ, const DnaSeq& seqT, bool extleft, XSeed& xseed, int mat, int mis, int gap, int dropoff)
 {
     int lenQ = seqQ.size();
@@ -78,8 +123,15 @@ int _extend_seed_one_direction(const DnaSeq& seqQ, const DnaSeq& seqT, bool extl
     ad3[0] = ad3[1] = (-gap > dropoff)? undef : gap;
 
     int ad_no = 1, best = 0;
-    int offsetQ = xseed.endQ;
-    int offsetT = xseed.endT;
+
+    /*
+     * Column col compares codesQ[col-1] against codesT[ad_no-col-1]. When
+     * xseed.rc is set the T coordinates refer to the reverse complement of
+     * seqT, so T is read in the opposite direction and complemented.
+     */
+    OutwardCodes codesQ(seqQ, extleft? xseed.begQ - 1 : xseed.endQ, lenQ_ext, extleft, false);
+    OutwardCodes codesT(seqT, xseed.rc? (extleft? lenT - xseed.begT : lenT - 1 - xseed.endT) : (extleft? xseed.begT - 1 : xseed.endT),
+                        lenT_ext, extleft != xseed.rc, xseed.rc);
 
     while (min_col < max_col)
     {
@@ -110,13 +162,8 @@ int _extend_seed_one_direction(const DnaSeq& seqQ, const DnaSeq& seqT, bool extl
             int i2 = col - offset2;
             int i1 = col - offset1;
 
-            int posQ, posT;
-
-            posQ = extleft? cols - 1 - col : col - 1 + offsetQ;
-            posT = extleft? rows - 1 + col - ad_no : ad_no - col - 1 + offsetT;
-
             int temp = std::max(ad2[i2-1], ad2[i2]) + gap;
-            int temp2 = ad1[i1-1] + ((seqQ[posQ] == (xseed.rc? seqT.revcomp_at(posT) : seqT.regular_at(posT)))? mat : mis);
+            int temp2 = ad1[i1-1] + ((codesQ[col-1] == codesT[ad_no-col-1])? mat : mis);
             temp = std::max(temp, temp2);
 
             if (temp < best - dropoff)
@@ -229,6 +276,31 @@ static inline int _xdrop_seed_and_extend_r(const DnaSeq& seqQ, const DnaSeq& seq
     return rscore;
 }
 
+static int _xdrop_extend_seed(const DnaSeq& seqQ, const DnaSeq& seqT, int mat, int mis, int gap, int dropoff, const XSeed& xseed, XSeed& result)
+{
+    int lenT = seqT.size();
+    bool rc = xseed.rc;
+
+    int begQ_ext, begT_ext, lscore;
+    int endQ_ext, endT_ext, rscore;
+
+    lscore = _xdrop_seed_and_extend_l(seqQ, seqT, mat, mis, gap, dropoff, xseed, begQ_ext, begT_ext);
+    rscore = _xdrop_seed_and_extend_r(seqQ, seqT, mat, mis, gap, dropoff, xseed, endQ_ext, endT_ext);
+
+    int score = lscore + rscore + mat * (xseed.endQ - xseed.begQ);
+
+    result.begQ = begQ_ext;
+    result.endQ = endQ_ext;
+
+    result.begT = rc? lenT - endT_ext : begT_ext;
+    result.endT = rc? lenT - begT_ext : endT_ext;
+
+    result.rc = rc;
+    result.score = score;
+
+    return score;
+}
+
 int xdrop_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int begQ, int begT, int mat, int mis, int gap, int dropoff, XSeed& result)
 {
     XSeed xseed;
@@ -247,9 +319,13 @@ int xdrop_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int begQ, int begT, in
 
     bool rc = (seqQ[begQ + (KMER_SIZE>>1)] != seqT[begT + (KMER_SIZE>>1)]);
 
-    for (int i = 0; i < KMER_SIZE; ++i)
+    for (int i = 0; i < KMER_SIZE; i += 32)
     {
-        if (seqQ[begQ + i] != (rc? seqT.revcomp_at(lenT - begT - KMER_SIZE + i) : seqT.regular_at(begT + i)))
+        uint64_t mask = KMER_SIZE - i < 32? ~0ULL << (2 * (32 - (KMER_SIZE - i))) : ~0ULL;
+        uint64_t wordQ = seqQ.getword(begQ + i);
+        uint64_t wordT = rc? seqT.getrcword(lenT - begT - KMER_SIZE + i) : seqT.getword(begT + i);
+
+        if ((wordQ ^ wordT) & mask)
             return -1;
     }
 
@@ -261,22 +337,42 @@ int xdrop_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int begQ, int begT, in
 
     xseed.rc = rc;
 
-    int begQ_ext, begT_ext, lscore;
-    int endQ_ext, endT_ext, rscore;
+    return _xdrop_extend_seed(seqQ, seqT, mat, mis, gap, dropoff, xseed, result);
+}
 
-    lscore = _xdrop_seed_and_extend_l(seqQ, seqT, mat, mis, gap, dropoff, xseed, begQ_ext, begT_ext);
-    rscore = _xdrop_seed_and_extend_r(seqQ, seqT, mat, mis, gap, dropoff, xseed, endQ_ext, endT_ext);
+int xdrop_anchor_aligner(const DnaSeq& seqQ, const DnaSeq& seqT, int anchorQ, int anchorT, int mat, int mis, int gap, int dropoff, XSeed& result)
+{
+    XSeed xseed;
 
-    int score = lscore + rscore + mat * KMER_SIZE;
+    int lenQ = seqQ.size();
+    int lenT = seqT.size();
 
-    result.begQ = begQ_ext;
-    result.endQ = endQ_ext;
+    if (anchorQ < 0 || anchorQ >= lenQ || anchorT < 0 || anchorT >= lenT)
+        return -1;
 
-    result.begT = rc? lenT - endT_ext : begT_ext;
-    result.endT = rc? lenT - begT_ext : endT_ext;
+    /*
+     * Both anchors are the first base of the same homopolymer run, so the
+     * bases are equal on the same strand and complementary on opposite strands.
+     */
+    bool rc = (seqQ[anchorQ] != seqT[anchorT]);
 
-    result.rc = rc;
-    result.score = score;
+    int runQ = 1, runT = 1;
+    while (anchorQ + runQ < lenQ && seqQ[anchorQ + runQ] == seqQ[anchorQ]) ++runQ;
+    while (anchorT + runT < lenT && seqT[anchorT + runT] == seqT[anchorT]) ++runT;
 
-    return score;
+    /*
+     * The seed is the part of the run that both reads have. On the reverse
+     * strand the run of T starts where it ends on the forward strand.
+     */
+    int seedlen = std::min(runQ, runT);
+
+    xseed.begQ = anchorQ;
+    xseed.endQ = xseed.begQ + seedlen;
+
+    xseed.begT = rc? lenT - anchorT - runT : anchorT;
+    xseed.endT = xseed.begT + seedlen;
+
+    xseed.rc = rc;
+
+    return _xdrop_extend_seed(seqQ, seqT, mat, mis, gap, dropoff, xseed, result);
 }
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "DnaSeq.hpp"
+
+/*
+ * Microbenchmark for the 2-bit DnaSeq kernels. Encodes and decodes a random
+ * sequence a number of times with both the scalar kernels and the ones picked
+ * at runtime, and reports the throughput in GB/s of ASCII nucleotides. It then
+ * extracts the 32-nucleotide window (and its reverse complement) starting at
+ * every position of the sequence, once assembled from per-nucleotide operator[]
+ * calls and once with getword/getrcword, and reports windows per second. Finally
+ * it checks that both kernels encode every byte value the same way.
+ *
+ * Usage: dnabench [number of nucleotides (default 64M)] [repetitions (default 10)]
+ */
+
+template <typename F>
+static double gbpersecond(size_t numbases, int reps, F kernel)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < reps; ++r)
+        kernel();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (static_cast<double>(numbases) * reps / 1e9) / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numbases = argc >= 2? std::strtoull(argv[1], nullptr, 10) : (64 << 20);
+    int reps = argc >= 3? std::atoi(argv[2]) : 10;
+
+    std::mt19937_64 gen(12345);
+    std::string seq(numbases, 'A');
+
+    for (size_t i = 0; i < numbases; ++i)
+        seq[i] = "ACGTacgtN"[gen() % 9];
+
+    std::vector<uint8_t> scalarbuf(DnaSeq::bytesneeded(numbases)), simdbuf(DnaSeq::bytesneeded(numbases));
+    std::string scalarstr(numbases, '\0'), simdstr(numbases, '\0');
+
+    double encscalar = gbpersecond(numbases, reps, [&]() { DnaSeq::encodescalar(seq.data(), numbases, scalarbuf.data()); });
+    double encsimd   = gbpersecond(numbases, reps, [&]() { DnaSeq::encode(seq.data(), numbases, simdbuf.data()); });
+    double decscalar = gbpersecond(numbases, reps, [&]() { DnaSeq::decodescalar(scalarbuf.data(), numbases, &scalarstr[0]); });
+    double decsimd   = gbpersecond(numbases, reps, [&]() { DnaSeq::decode(simdbuf.data(), numbases, &simdstr[0]); });
+
+    DnaSeq dna(numbases, simdbuf.data());
+    uint64_t basesum = 0, wordsum = 0;
+
+    double winbase = gbpersecond(numbases, reps, [&]()
+    {
+        for (size_t i = 0; i < numbases; ++i)
+        {
+            uint64_t word = 0, rcword = 0;
+
+            for (size_t j = 0; j < 32 && i + j < numbases; ++j)
+            {
+                word |= static_cast<uint64_t>(dna[i+j]) << (62 - 2*j);
+                rcword |= static_cast<uint64_t>(dna.revcomp_at(i+j)) << (62 - 2*j);
+            }
+
+            basesum += word ^ (rcword >> 1);
+        }
+    });
+
+    double winword = gbpersecond(numbases, reps, [&]()
+    {
+        for (size_t i = 0; i < numbases; ++i)
+            wordsum += dna.getword(i) ^ (dna.getrcword(i) >> 1);
+    });
+
+    /*
+     * Every byte value, not only the nucleotides and N, has to encode the same way
+     * with both kernels, in each of the 4 positions of an encoded byte.
+     */
+    std::string allbytes(4 * 256 * 4, '\0');
+
+    for (size_t i = 0; i < allbytes.size(); ++i)
+        allbytes[i] = static_cast<char>((i / 4 + 64 * (i % 4) + i / 1024) & 0xFF);
+
+    std::vector<uint8_t> scalarbytes(DnaSeq::bytesneeded(allbytes.size())), simdbytes(DnaSeq::bytesneeded(allbytes.size()));
+
+    DnaSeq::encodescalar(allbytes.data(), allbytes.size(), scalarbytes.data());
+    DnaSeq::encode(allbytes.data(), allbytes.size(), simdbytes.data());
+
+    bool ok = (scalarbuf == simdbuf) && (scalarstr == simdstr) && (basesum == wordsum) && (scalarbytes == simdbytes);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "nucleotides: " << numbases << ", repetitions: " << reps << ", kernels: " << DnaSeq::simdname() << "\n"
+              << "encode scalar: " << encscalar << " GB/s\n"
+              << "encode " << DnaSeq::simdname() << ": " << encsimd << " GB/s (" << encsimd / encscalar << "x)\n"
+              << "decode scalar: " << decscalar << " GB/s\n"
+              << "decode " << DnaSeq::simdname() << ": " << decsimd << " GB/s (" << decsimd / decscalar << "x)\n"
+              << "windows per-base operator[]: " << winbase << " G windows/s\n"
+              << "windows getword/getrcword: " << winword << " G windows/s (" << winword / winbase << "x)\n"
+              << "scalar and " << DnaSeq::simdname() << " results " << (ok? "match" : "DIFFER") << std::endl;
+
+    return ok? 0 : 1;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <mpi.h>
+
+#include "common.h"
+#include "FastaIndex.hpp"
+#include "DnaBuffer.hpp"
+#include "ElbaSeq.hpp"
+#include "MPITimer.hpp"
+
+/*
+ * One-time conversion of a FASTA (or FASTQ, possibly BGZF compressed) file into
+ * an .elbaseq file of 2-bit encoded reads. ELBA recognizes .elbaseq input by its
+ * magic bytes, so the converted file can be passed to ELBA in place of the FASTA.
+ */
+int main(int argc, char **argv)
+{
+    int returncode = 0;
+
+    MPI_Init(&argc, &argv);
+    {
+        std::shared_ptr<CommGrid> commgrid(new CommGrid(MPI_COMM_WORLD, 0, 0));
+        int myrank = commgrid->GetRank();
+
+        if (argc < 2)
+        {
+            if (myrank == 0) std::cerr << "Usage: " << argv[0] << " <reads.fa> [reads.elbaseq]" << std::endl;
+            returncode = -1;
+        }
+        else
+        {
+            std::string fasta_fname = argv[1];
+            std::string elbaseq_fname = argc >= 3? argv[2] : fasta_fname + ".elbaseq";
+
+            MPITimer timer(MPI_COMM_WORLD);
+            std::ostringstream ss;
+
+            timer.start();
+            FastaIndex index(fasta_fname, commgrid, true);
+            DnaBuffer mydna = index.getmydna();
+            ss << "reading and 2-bit encoding " << std::quoted(fasta_fname);
+            timer.stop_and_log(ss.str().c_str());
+            ss.clear(); ss.str("");
+
+            timer.start();
+            writeelbaseq(elbaseq_fname, index, mydna, index.getmynames());
+            ss << "writing " << std::quoted(elbaseq_fname);
+            timer.stop_and_log(ss.str().c_str());
+        }
+    }
+    MPI_Finalize();
+
+    return returncode;
+}
@@ -25,6 +25,7 @@ derivative works, and perform publicly and display publicly, and to permit other
 #include "compiletime.h"
 #include "Logger.hpp"
 #include "FastaIndex.hpp"
+#include "ReadNames.hpp"
 #include "DistributedFastaData.hpp"
 #include "Kmer.hpp"
 #include "KmerOps.hpp"
@@ -34,6 +35,7 @@ derivative works, and perform publicly and display publicly, and to permit other
 #include "ContigGeneration.hpp"
 #include "PruneChimeras.hpp"
 #include "MPITimer.hpp"
+#include "MemoryBudget.hpp"
 #include "ELBALogger.hpp"
 
 int returncode;
@@ -60,11 +62,70 @@ int xdrop_cutoff = 15; /* x-drop cutoff score */
  */
 double bad_read_cutoff = 0.65;
 
+/*
+ * FASTA ingest window size in megabytes (0 means whole partition).
+ */
+int fasta_window_mb = 0;
+
+/*
+ * Parse the FASTA index in parallel instead of on the root process.
+ */
+int distributed_faidx = 0;
+
+/*
+ * Keep one copy of the grid row and column reads per node in shared memory.
+ */
+int shared_grid_reads = 0;
+
+/*
+ * Parse k-mers from homopolymer-compressed reads.
+ */
+int hpc_kmers = 0;
+
+/*
+ * Seed only with (w,k)-minimizers (-m) or closed (-y) or open (-Y) syncmers
+ * instead of every k-mer (see KmerSampling.hpp).
+ */
+int sampling_mode = KmerSampling::ALL_KMERS;
+int sampling_param = 0;
+
+/*
+ * Only seed with about one in every stride k-mers, picked by hash so
+ * that overlapping reads keep the same ones.
+ */
+int kmer_stride = 1;
+
+/*
+ * Only k-mers seen between lower_kmer_freq and upper_kmer_freq times are reliable.
+ * If kmer_bounds_prob is positive, the bounds are instead picked from the k-mer
+ * histogram, upper_kmer_freq being the largest upper bound picked (see KmerBounds.hpp).
+ */
+int lower_kmer_freq = LOWER_KMER_FREQ;
+int upper_kmer_freq = UPPER_KMER_FREQ;
+double kmer_bounds_prob = 0;
+
+/*
+ * Count k-mers with a single k-mer exchange instead of two, at the cost of memory.
+ */
+int fused_counting = 0;
+
+/*
+ * Most megabytes of k-mers a process sends in one round of a k-mer exchange,
+ * or 0 to size the rounds from the memory budget.
+ */
+int kmer_batch_mb = 0;
+
+/*
+ * Most megabytes of memory the processes of a node use together, or 0 for
+ * whatever the node has available (see MemoryBudget.hpp).
+ */
+int node_memory_mb = 0;
+
 constexpr int root = 0; /* root process rank */
 
 int parse_cli(int argc, char *argv[]);
 void print_kmer_histogram(const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid);
-void parallel_write_paf(const CT<Overlap>::PSpParMat& R, DistributedFastaData& dfd, char const *pafname);
+void parallel_write_paf(const CT<Overlap>::PSpParMat& R, DistributedFastaData& dfd, ReadNames& readnames, char const *pafname);
 void parallel_write_contigs(const std::vector<std::string>& contigs, MPI_Comm comm);
 CT<int64_t>::PDistVec find_contained_reads(const CT<Overlap>::PSpParMat& R);
 CT<int64_t>::PDistVec find_bad_reads(const CT<Overlap>::PSpParMat& R, double cutoff);
@@ -107,14 +168,23 @@ int main(int argc, char **argv)
         MPITimer timer(comm), walltimer(comm);
         walltimer.start();
 
+        MemoryBudget membudget(comm, node_memory_mb);
+
+        if (myrank == root)
+        {
+            std::cout << "memory budget: " << (membudget.getbudget() >> 20) << " MB per process ("
+                      << (membudget.getnodeavailable() >> 20) << " MB usable on a node with up to "
+                      << membudget.getranksonnode() << " processes)\n" << std::endl;
+        }
+
         /*
          * FastaIndex @index is the structure responsible for reading
          * the .fai index file and telling each process which read sequences
          * it is responsible for parsing, compressing and storing.
          */
         timer.start();
-        FastaIndex index(fasta_fname, commgrid);
-        ss << "reading " << std::quoted(index.get_faidx_fname()) << " and scattering to all MPI tasks";
+        FastaIndex index(fasta_fname, commgrid, distributed_faidx);
+        ss << "reading " << std::quoted(index.get_faidx_fname()) << (distributed_faidx? " in parallel and partitioning it across all MPI tasks" : " and scattering to all MPI tasks");
         timer.stop_and_log(ss.str().c_str());
         ss.clear(); ss.str("");
 
@@ -123,7 +193,7 @@ int main(int argc, char **argv)
          * to it by the .fai index file, as determined by @index.
          */
         timer.start();
-        DnaBuffer mydna = index.getmydna();
+        DnaBuffer mydna = index.getmydna(static_cast<size_t>(fasta_window_mb) * 1024 * 1024);
         ss << "reading and 2-bit encoding " << std::quoted(index.get_fasta_fname()) << " sequences in parallel";
         timer.stop_and_log(ss.str().c_str());
         ss.clear(); ss.str("");
@@ -134,33 +204,32 @@ int main(int argc, char **argv)
          * 2D processor grid. The constructor determines this from the FastaIndex
          * @index.
          */
-        DistributedFastaData dfd(index);
+        DistributedFastaData dfd(index, shared_grid_reads);
 
         /*
          * Initiate non-blocking send and receive calls. The end goal
          * is that every processor has the reads it requires according
          * the original construction above. These are stored as DnaBuffer
-         * objects owned by @dfd.
+         * objects owned by @dfd (in node shared memory with -S).
          *
          * Because this is non-blocking, we have to call dfd.wait() to
          * make sure every processor has finished its sends and receives.
          * We do this after the k-mer counting step, because that step
-         * only needs access to the sequences stored in mydna.
+         * only needs access to the sequences stored in mydna. In between,
+         * dfd.progress() lets the exchange move along without blocking.
          */
         dfd.collect_sequences(mydna);
 
         /*
          * The next steps can be understood by first describing what @kmermap
-         * is. @kmermap is an unordered_map (basically an associative container)
-         * mapping k-mers to "k-mer count entries". Formally, a "k-mer count entry"
-         * is a triple (READIDS, POSITIONS, count) where READIDS is an array of global
-         * read IDs, POSITIONS is an array of read positions, and count is the number
+         * is. @kmermap is a hash table (see KmerCountMap.hpp) mapping k-mers to
+         * "k-mer count entries". Formally, a "k-mer count entry" is a count and a list
+         * of occurrences (global read ID, read position), where count is the number
          * of distinct times that k-mer has been found in the FASTA sequences (globally).
          *
-         * It should be noted that READIDS and POSITIONS are arrays with a fixed size,
-         * determined by the compile-time parameter UPPER_KMER_FREQ. This is because
-         * we only want to store k-mers that appear <= UPPER_KMER_FREQ different times
-         * in the input.
+         * It should be noted that we only want to store k-mers that appear
+         * <= upper_kmer_freq different times in the input, so no list ever gets
+         * longer than that.
          *
          * @kmermap is a "distributed" hash table in the sense that each processor
          * has its own local instance which is individually responsible for a different
@@ -180,50 +249,94 @@ int main(int argc, char **argv)
          *
          *    3. All processors collectively send their locally found k-mers to their proper
          *       destinations. In parallel, each processor receives incoming k-mers assigned to
-         *       it, and filters out likely singletons using a Bloom filter approach. Only
-         *       distinct k-mers are kept.
+         *       it, and filters out likely singletons using a Bloom filter approach. The
+         *       other k-mers are counted.
          *
-         *    4. The received distinct k-mers are used to initialize @kmermap with empty "kmer count
-         *       entries." Those entries are filled out in the second pass implemented in
-         *       @get_kmer_count_map_values().
+         *    4. The k-mers whose counts are outside the frequency bounds are dropped, and
+         *       the others get room for exactly as many occurrences as they were counted,
+         *       packed one k-mer after the other. Those occurrences are filled out in the
+         *       second pass implemented in @get_kmer_count_map_values().
          *
          */
-        timer.start();
-        kmermap = get_kmer_count_map_keys(mydna, commgrid);
-        timer.stop_and_log("collecting distinct k-mers");
+        /*
+         * With -H, k-mers are parsed from homopolymer-compressed copies of
+         * the reads, so that they match despite homopolymer length errors. Their
+         * positions still refer to @mydna, which the alignments run on.
+         */
+        std::unique_ptr<HpcBuffer> hpcdna;
+        KmerSampling sampling(static_cast<KmerSampling::Mode>(sampling_mode), sampling_param, kmer_stride);
+        KmerBounds bounds(lower_kmer_freq, upper_kmer_freq, kmer_bounds_prob);
+
+        if (hpc_kmers)
+        {
+            timer.start();
+            hpcdna = std::make_unique<HpcBuffer>(mydna);
+            timer.stop_and_log("homopolymer-compressing reads");
+        }
 
         /*
-         * Now that every process has its local partition of the distributed k-mer hash table
-         * initialized with all the keys (k-mers) it needs, we do a second pass over every k-mer
-         * and send them to their destinations, this time including information about which read ID
-         * the k-mer was parsed from, and the position of the k-mer within that read. Using the
-         * Bloom filter, we can quickly query received k-mers and discard those k-mers which we know
-         * aren't keys in the local @kmermap.
-         *
-         * For each received k-mer that passes through the Bloom filter (is accepted), its
-         * corresponding triple (READIDS, POSITIONS, count) is updated. This way, the local
-         * process is able to quickly find all the reads (via their global IDs) that contain a particular
-         * k-mer, and quickly find the position within that read where the k-mer is located. The
-         * count parameter merely states how many times that k-mer has been found in the dataset,
-         * and is therefore equivalent to the number of used entries of READIDS and POSITIONS.
-         *
-         * Suppose that a k-mer @s appears more that UPPER_KMER_FREQ times in the input. Then
-         * it is guaranteed that, eventually, the processor responsible for storing @s will
-         * receive an instance of @s (plus a global read id and position where @s came from) that
-         * will put it over the capacity of POSITIONS and READIDS. We therefore always check
-         * if a received k-mer will push us over this threshold, and if it does, we DELETE the
-         * k-mer key of @s on the owner processor. That way, any other instances of @s from
-         * other reads are discarded because we only record entries for k-mers that exist in
-         * the hash table.
-         *
-         * Finally, once the collective exchange is finished, we delete all k-mer keys of
-         * k-mers that appeared less than LOWER_KMER_FREQ times. The result is a distributed
-         * hash table mapping reliable k-mers (k-mers that appear within the defined frequency bounds)
-         * to their corresponding k-mer count entries.
+         * A round of k-mer exchange holds the parsed k-mers, the send buffer and
+         * the receive buffer at once, each about as large as what it sends, while
+         * the hash table grows next to them. So unless -b says otherwise, a round
+         * sends at most a quarter of what is left of the budget.
          */
-        timer.start();
-        get_kmer_count_map_values(mydna, *kmermap, commgrid);
-        timer.stop_and_log("counting recording k-mer seeds");
+        membudget.start_with_budget();
+        size_t batchmem = kmer_batch_mb? static_cast<size_t>(kmer_batch_mb) * 1024 * 1024 : membudget.getphasebudget() / 4;
+
+        /*
+         * With -F, both passes below are done with a single exchange of k-mer seeds,
+         * see get_kmer_count_map_fused(). Every processor then keeps the first occurrence
+         * of every k-mer it owns until all k-mers have arrived, so this is for when there is
+         * memory to spare (or a local disk to spill to).
+         */
+        if (fused_counting)
+        {
+            timer.start();
+            kmermap = get_kmer_count_map_fused(mydna, commgrid, bounds, hpcdna.get(), sampling, batchmem);
+            timer.stop_and_log("counting k-mers in a single exchange");
+        }
+        else
+        {
+            timer.start();
+            kmermap = get_kmer_count_map_keys(hpcdna? hpcdna->getdna() : mydna, commgrid, bounds, sampling, batchmem);
+            timer.stop_and_log("collecting distinct k-mers");
+
+            dfd.progress();
+
+            /*
+             * Now that every process has its local partition of the distributed k-mer hash table
+             * initialized with all the keys (k-mers) it needs, we do a second pass over every k-mer
+             * and send them to their destinations, this time including information about which read ID
+             * the k-mer was parsed from, and the position of the k-mer within that read. Using the
+             * Bloom filter, we can quickly query received k-mers and discard those k-mers which we know
+             * aren't keys in the local @kmermap.
+             *
+             * For each received k-mer that passes through the Bloom filter (is accepted), its
+             * corresponding count and occurrence list are updated. This way, the local
+             * process is able to quickly find all the reads (via their global IDs) that contain a particular
+             * k-mer, and quickly find the position within that read where the k-mer is located. The
+             * count parameter merely states how many times that k-mer has been found in the dataset,
+             * and is therefore equivalent to the length of the occurrence list.
+             *
+             * A k-mer @s that appears more than upper_kmer_freq or less than lower_kmer_freq times
+             * in the input was already dropped after the first pass, so any instances of @s are
+             * discarded because we only record entries for k-mers that exist in the hash table.
+             * The first pass counts can only be one too high (when the Bloom filter was wrong
+             * about the first occurrence of a k-mer), so once the collective exchange is finished,
+             * we delete the few k-mer keys whose exact counts fall just outside the bounds. The result is a distributed
+             * hash table mapping reliable k-mers (k-mers that appear within the defined frequency bounds)
+             * to their corresponding k-mer count entries.
+             */
+            timer.start();
+            get_kmer_count_map_values(mydna, *kmermap, commgrid, bounds, hpcdna.get(), sampling, batchmem);
+            timer.stop_and_log("counting recording k-mer seeds");
+        }
+
+        membudget.stop_and_log("counting k-mers");
+
+        hpcdna.reset();
+
+        dfd.progress();
 
         print_kmer_histogram(*kmermap, commgrid);
 
@@ -234,20 +347,20 @@ int main(int argc, char **argv)
          * operation using a custom semiring. More on that will be discussed later. For now,
          * this is what @A is:
          *
-         *    Let M = number of reads in FASTA;
+         *    Let M = number of reads in FASTA, padded so that every grid row gets the same number of rows;
          *    Let N = number of distinct k-mers (keys) currently stored in distributed k-mer hash table;
          *    Let L = total number of k-mer instances (values) currently stored in the distributed k-mer hash table;
          *
          *    Then @A is an M-by-N distributed sparse matrix with L nonzeros, where a nonzero at
          *    @A(i,j) represents an instance of a k-mer (with global id j) found in
-         *    read sequence i (global id). The global k-mer ids are computed using a prefix
-         *    scan of the stored k-mer keys in the distributed hash table. The actual
-         *    value stored by the nonzero is the POSITION of k-mer j within read i.
+         *    read sequence i (matrix id, see DistributedFastaData). The global k-mer ids are
+         *    computed using a prefix scan of the stored k-mer keys in the distributed hash table.
+         *    The actual value stored by the nonzero is the POSITION of k-mer j within read i.
          *
          * A few quick observations on what this means:
          *
          *    The number of nonzeros in the row @A(i,:) is the number of distinct reliable k-mers
-         *    found within the sequence with global id i.
+         *    found within the sequence with matrix id i.
          *
          *    The number of nonzeros in the column @A(:,j) is the number of different sequences
          *    that contain the reliable k-mer with id j as a subsequence.
@@ -255,8 +368,9 @@ int main(int argc, char **argv)
          * Other similar observations about the nature of @A can be made, but hopefully it
          * is clear by now what @A is.
          */
+        membudget.start();
         timer.start();
-        A = create_kmer_matrix(mydna, *kmermap, commgrid);
+        A = create_kmer_matrix(*kmermap, dfd, commgrid);
         timer.stop_and_log("creating k-mer matrix");
 
         /*
@@ -272,14 +386,17 @@ int main(int argc, char **argv)
         AT = std::make_unique<CT<PosInRead>::PSpParMat>(*A);
         AT->Transpose();
         timer.stop_and_log("copying and transposing k-mer matrix");
+        membudget.stop_and_log("creating k-mer matrix");
         elbalog.log_kmer_matrix(*A);
 
         /*
          * TODO: comment this.
          */
+        membudget.start();
         timer.start();
         B = create_seed_matrix(*A, *AT);
         timer.stop_and_log("creating seed matrix (spgemm)");
+        membudget.stop_and_log("creating seed matrix (spgemm)");
 
         A.reset();
         AT.reset();
@@ -296,11 +413,19 @@ int main(int argc, char **argv)
          * alignments on each nonzero (actually only half since @B is symmetric)
          * and then prune the alignments that appear spurious.
          */
+        membudget.start();
         timer.start();
-        R = PairwiseAlignment(dfd, *B, mat, mis, gap, xdrop_cutoff);
+        R = PairwiseAlignment(dfd, *B, mat, mis, gap, xdrop_cutoff, hpc_kmers);
         timer.stop_and_log("pairwise alignment");
+        membudget.stop_and_log("pairwise alignment");
 
-        parallel_write_paf(*R, dfd, get_overlap_paf_name().c_str());
+        /*
+         * Read names stay with the processors that own the reads. The PAF
+         * writers fetch the names they need, which @readnames caches.
+         */
+        ReadNames readnames(index);
+
+        parallel_write_paf(*R, dfd, readnames, get_overlap_paf_name().c_str());
 
         auto bad_reads = find_bad_reads(*R, bad_read_cutoff);
         R->Prune([](const Overlap& nz) { return !nz.passed; });
@@ -314,7 +439,7 @@ int main(int argc, char **argv)
         timer.stop_and_log("contained read removal and transitive reduction");
         R.reset();
 
-        parallel_write_paf(*S, dfd, get_string_paf_name().c_str());
+        parallel_write_paf(*S, dfd, readnames, get_string_paf_name().c_str());
 
         timer.start();
         std::vector<std::string> contigs = GenerateContigs(*S, mydna, dfd);
@@ -353,6 +478,20 @@ void usage(char const *prg)
               << "         -B INT   mismatch penalty ["           << -mis                        << "]\n"
               << "         -G INT   gap penalty ["                << -gap                        << "]\n"
               << "         -c FLOAT bad read alignment cutoff ["  <<  bad_read_cutoff            << "]\n"
+              << "         -w INT   FASTA read window in MB ["    <<  fasta_window_mb            << "]\n"
+              << "         -d       parse FASTA index in parallel\n"
+              << "         -S       share grid row/column reads within a node\n"
+              << "         -H       homopolymer-compressed k-mers\n"
+              << "         -s INT   k-mer stride ["               <<  kmer_stride                << "]\n"
+              << "         -m INT   seed with (w,k)-minimizers of window INT\n"
+              << "         -y INT   seed with closed syncmers of s-mer size INT\n"
+              << "         -Y INT   seed with open syncmers of s-mer size INT\n"
+              << "         -l INT   lower k-mer frequency bound ["  <<  lower_kmer_freq            << "]\n"
+              << "         -u INT   upper k-mer frequency bound ["  <<  upper_kmer_freq            << "]\n"
+              << "         -a FLOAT pick k-mer bounds with tail probability FLOAT\n"
+              << "         -F       count k-mers in a single exchange\n"
+              << "         -b INT   k-mer exchange batch size in MB [" <<  kmer_batch_mb              << "]\n"
+              << "         -M INT   memory per node in MB ["      <<  node_memory_mb             << "]\n"
               << "         -o STR   output file name prefix "     <<  std::quoted(output_prefix) << "\n"
               << "         -h       help message"
               << std::endl;
@@ -360,32 +499,59 @@ void usage(char const *prg)
 
 int parse_cli(int argc, char *argv[])
 {
-    int params[4] = {mat, mis, gap, xdrop_cutoff};
+    int params[16] = {mat, mis, gap, xdrop_cutoff, fasta_window_mb, distributed_faidx, shared_grid_reads, hpc_kmers, sampling_mode, sampling_param, kmer_stride, fused_counting, kmer_batch_mb, node_memory_mb, lower_kmer_freq, upper_kmer_freq};
     int show_help = 0, fasta_provided = 1;
 
     if (myrank == root)
     {
         int c;
 
-        while ((c = getopt(argc, argv, "x:c:A:B:G:o:h")) >= 0)
+        while ((c = getopt(argc, argv, "x:c:A:B:G:o:w:s:m:y:Y:b:M:l:u:a:dSHFh")) >= 0)
         {
             if      (c == 'A') params[0] =  atoi(optarg);
             else if (c == 'B') params[1] = -atoi(optarg);
             else if (c == 'G') params[2] = -atoi(optarg);
             else if (c == 'x') params[3] =  atoi(optarg);
+            else if (c == 'w') params[4] =  atoi(optarg);
+            else if (c == 'd') params[5] =  1;
+            else if (c == 'S') params[6] =  1;
+            else if (c == 'H') params[7] =  1;
+            else if (c == 'F') params[11] = 1;
+            else if (c == 'b') params[12] = atoi(optarg);
+            else if (c == 'M') params[13] = atoi(optarg);
+            else if (c == 'l') params[14] = atoi(optarg);
+            else if (c == 'u') params[15] = atoi(optarg);
+            else if (c == 's') params[10] = atoi(optarg);
+            else if (c == 'm') params[8] =  KmerSampling::MINIMIZERS,      params[9] = atoi(optarg);
+            else if (c == 'y') params[8] =  KmerSampling::CLOSED_SYNCMERS, params[9] = atoi(optarg);
+            else if (c == 'Y') params[8] =  KmerSampling::OPEN_SYNCMERS,   params[9] = atoi(optarg);
             else if (c == 'c') bad_read_cutoff = atof(optarg);
+            else if (c == 'a') kmer_bounds_prob = atof(optarg);
             else if (c == 'o') output_prefix = std::string(optarg);
             else if (c == 'h') show_help = 1;
         }
     }
 
-    MPI_BCAST(params, 4, MPI_INT, root, comm);
+    MPI_BCAST(params, 16, MPI_INT, root, comm);
     MPI_BCAST(&bad_read_cutoff, 1, MPI_DOUBLE, root, comm);
+    MPI_BCAST(&kmer_bounds_prob, 1, MPI_DOUBLE, root, comm);
 
     mat          = params[0];
     mis          = params[1];
     gap          = params[2];
     xdrop_cutoff = params[3];
+    fasta_window_mb = params[4];
+    distributed_faidx = params[5];
+    shared_grid_reads = params[6];
+    hpc_kmers = params[7];
+    sampling_mode = params[8];
+    sampling_param = params[9];
+    kmer_stride = params[10];
+    fused_counting = params[11];
+    kmer_batch_mb = params[12];
+    node_memory_mb = params[13];
+    lower_kmer_freq = params[14];
+    upper_kmer_freq = params[15];
 
     if (myrank == root && show_help)
         usage(argv[0]);
@@ -403,6 +569,30 @@ int parse_cli(int argc, char *argv[])
     MPI_BCAST(&fasta_provided, 1, MPI_INT, root, comm);
     if (!fasta_provided) return -1;
 
+    KmerSampling sampling(static_cast<KmerSampling::Mode>(sampling_mode), sampling_param, kmer_stride);
+    std::string sampling_error = sampling.Check();
+
+    if (!sampling_error.empty())
+    {
+        if (myrank == root) std::cerr << "error: " << sampling_error << "\n";
+        return -1;
+    }
+
+    KmerBounds bounds(lower_kmer_freq, upper_kmer_freq, kmer_bounds_prob);
+    std::string bounds_error = bounds.Check();
+
+    if (!bounds_error.empty())
+    {
+        if (myrank == root) std::cerr << "error: " << bounds_error << "\n";
+        return -1;
+    }
+
+    if (fasta_window_mb < 0 || kmer_batch_mb < 0 || node_memory_mb < 0)
+    {
+        if (myrank == root) std::cerr << "error: memory sizes can't be negative\n";
+        return -1;
+    }
+
     int fnamelen, onamelen;
 
     if (myrank == root)
@@ -412,8 +602,6 @@ int parse_cli(int argc, char *argv[])
         onamelen = output_prefix.size();
 
         std::cout << "-DKMER_SIZE="            << KMER_SIZE            << "\n"
-                  << "-DLOWER_KMER_FREQ="      << LOWER_KMER_FREQ      << "\n"
-                  << "-DUPPER_KMER_FREQ="      << UPPER_KMER_FREQ      << "\n"
                   << "-DMPI_HAS_LARGE_COUNTS=" << MPI_HAS_LARGE_COUNTS << "\n"
         #ifdef USE_BLOOM
                   << "-DUSE_BLOOM\n"
@@ -424,6 +612,18 @@ int parse_cli(int argc, char *argv[])
                   << "int gap = "                << gap                        << ";\n"
                   << "int xdrop_cutoff = "       << xdrop_cutoff               << ";\n"
                   << "double bad_read_cutoff = " << bad_read_cutoff            << ";\n"
+                  << "int fasta_window_mb = "    << fasta_window_mb            << ";\n"
+                  << "int distributed_faidx = "  << distributed_faidx          << ";\n"
+                  << "int shared_grid_reads = "  << shared_grid_reads          << ";\n"
+                  << "int hpc_kmers = "          << hpc_kmers                  << ";\n"
+                  << "int kmer_stride = "        << kmer_stride                << ";\n"
+                  << "int lower_kmer_freq = "    << lower_kmer_freq            << ";\n"
+                  << "int upper_kmer_freq = "    << upper_kmer_freq            << ";\n"
+                  << "double kmer_bounds_prob = " << kmer_bounds_prob          << ";\n"
+                  << "int fused_counting = "     << fused_counting             << ";\n"
+                  << "int kmer_batch_mb = "      << kmer_batch_mb              << ";\n"
+                  << "int node_memory_mb = "     << node_memory_mb             << ";\n"
+                  << "String sampling = "        << std::quoted(sampling.GetString()) << ";\n"
                   << "String fname = "           << std::quoted(fasta_fname)   << ";\n"
                   << "String output_prefix = "   << std::quoted(output_prefix) << ";\n\n"
                   << "MPI processes = " << nprocs << "\n"
@@ -449,20 +649,13 @@ int parse_cli(int argc, char *argv[])
 void print_kmer_histogram(const KmerCountMap& kmermap, std::shared_ptr<CommGrid> commgrid)
 {
     #if LOG_LEVEL >= 2
-    int maxcount = std::accumulate(kmermap.cbegin(), kmermap.cend(), 0, [](int cur, const auto& entry) { return std::max(cur, std::get<2>(entry.second)); });
-
-    MPI_Allreduce(MPI_IN_PLACE, &maxcount, 1, MPI_INT, MPI_MAX, commgrid->GetWorld());
+    int maxcount = 0;
 
-    std::vector<int> histo(maxcount+1, 0);
+    kmermap.foreach([&](const KmerCountMap::Entry& entry) { maxcount = std::max(maxcount, entry.count); });
 
-    for (auto itr = kmermap.cbegin(); itr != kmermap.cend(); ++itr)
-    {
-        int cnt = std::get<2>(itr->second);
-        assert(cnt >= 1);
-        histo[cnt]++;
-    }
+    MPI_Allreduce(MPI_IN_PLACE, &maxcount, 1, MPI_INT, MPI_MAX, commgrid->GetWorld());
 
-    MPI_Allreduce(MPI_IN_PLACE, histo.data(), maxcount+1, MPI_INT, MPI_SUM, commgrid->GetWorld());
+    std::vector<int64_t> histo = get_kmer_histogram(kmermap, commgrid, maxcount);
 
     int myrank = commgrid->GetRank();
 
@@ -511,18 +704,35 @@ void parallel_write_contigs(const std::vector<std::string>& contigs, MPI_Comm co
     MPI_File_close(&cfh);
 }
 
-void parallel_write_paf(const CT<Overlap>::PSpParMat& R, DistributedFastaData& dfd, char const *pafname)
+void parallel_write_paf(const CT<Overlap>::PSpParMat& R, DistributedFastaData& dfd, ReadNames& readnames, char const *pafname)
 {
-    auto index = dfd.getindex();
+    auto& index = dfd.getindex();
     auto commgrid = index.getcommgrid();
     int myrank = commgrid->GetRank();
     int nprocs = commgrid->GetSize();
     MPI_Comm comm = commgrid->GetWorld();
 
-    std::vector<std::string> names = index.bcastnames();
-
     auto dcsc = R.seqptr()->GetDCSC();
 
+    /*
+     * Fetch the names of the reads that my nonzeros refer to.
+     */
+    std::vector<size_t> readids;
+
+    if (dcsc != NULL)
+    {
+        readids.reserve(2 * dcsc->cp[dcsc->nzc]);
+
+        for (int64_t i = 0; i < dcsc->nzc; ++i)
+            for (int64_t j = dcsc->cp[i]; j < dcsc->cp[i+1]; ++j)
+            {
+                readids.push_back(dcsc->ir[j] + dfd.getrowstartid());
+                readids.push_back(dcsc->jc[i] + dfd.getcolstartid());
+            }
+    }
+
+    readnames.fetch(std::move(readids));
+
     std::ostringstream ss;
     if (dcsc != NULL)
         for (int64_t i = 0; i < dcsc->nzc; ++i)
@@ -537,8 +747,8 @@ void parallel_write_paf(const CT<Overlap>::PSpParMat& R, DistributedFastaData& d
 
                 int maplen = std::max(std::get<0>(o.end) - std::get<0>(o.beg), std::get<1>(o.end) - std::get<1>(o.end));
 
-                ss << names[globalrow] << "\t" << std::get<0>(o.len) << "\t" << std::get<0>(o.beg) << "\t" << std::get<0>(o.end) << "\t" << "+-"[static_cast<int>(o.rc)] << "\t"
-                << names[globalcol] << "\t" << std::get<1>(o.len) << "\t" << std::get<1>(o.beg) << "\t" << std::get<1>(o.end) << "\t" << o.score << "\t" << maplen << "\t255\t" << static_cast<int>(o.passed) << "\n";
+                ss << readnames[globalrow] << "\t" << std::get<0>(o.len) << "\t" << std::get<0>(o.beg) << "\t" << std::get<0>(o.end) << "\t" << "+-"[static_cast<int>(o.rc)] << "\t"
+                << readnames[globalcol] << "\t" << std::get<1>(o.len) << "\t" << std::get<1>(o.beg) << "\t" << std::get<1>(o.end) << "\t" << o.score << "\t" << maplen << "\t255\t" << static_cast<int>(o.passed) << "\n";
             }
 
     std::string pafcontents = ss.str();